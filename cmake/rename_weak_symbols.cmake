@@ -0,0 +1,42 @@
+# Copies the relocatable object INPUT to OUTPUT, appending SUFFIX to the name
+# of every weak symbol it defines and of every COMDAT group it holds, other
+# than typeinfo. Run with cmake -P, passing NM and OBJCOPY.
+#
+# Header-only code, from GroupKey to the standard library, is emitted as weak
+# symbols in COMDAT groups, which the linker folds into a single copy across
+# objects. The query variants compile the same code for different instruction
+# sets, so their copies must not fold into each other's or the baseline's.
+# Typeinfo is kept: it holds no code, and exceptions and dynamic_cast compare
+# it across the program.
+
+execute_process(
+        COMMAND ${NM} ${INPUT}
+        OUTPUT_VARIABLE symbols
+        RESULT_VARIABLE result
+)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${NM} ${INPUT} failed")
+endif()
+
+# W and V are weak functions and objects, n the signatures of the groups that
+# hold a constructor's or destructor's aliases.
+string(REGEX MATCHALL "[^\n]+" lines "${symbols}")
+set(renames "")
+foreach(line IN LISTS lines)
+    if(line MATCHES " [WVn] ([^ ]+)$")
+        set(symbol ${CMAKE_MATCH_1})
+        if(NOT symbol MATCHES "^_ZT[IS]")
+            string(APPEND renames "${symbol} ${symbol}${SUFFIX}\n")
+        endif()
+    endif()
+endforeach()
+
+file(WRITE ${OUTPUT}.renames "${renames}")
+
+execute_process(
+        COMMAND ${OBJCOPY} --redefine-syms=${OUTPUT}.renames ${INPUT} ${OUTPUT}
+        RESULT_VARIABLE result
+)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${OBJCOPY} ${INPUT} failed")
+endif()
@@ -211,49 +211,121 @@ CREATE TABLE yearmonth_codes
 .import date.tbl date
 .import lineorder.tbl lineorder
 
-INSERT INTO mfgr_codes (mfgr)
-SELECT DISTINCT p_mfgr
-FROM part
-ORDER BY p_mfgr;
+-- Codes number the distinct values in sorted order, so that comparing codes
+-- compares the values they encode. The values numbered are those of SSB's
+-- fixed domains, which dbgen draws from at every scale factor, along with any
+-- other the tables hold. So a small database that lacks some brands or cities
+-- gets the same codes as a full one, and the queries' group-by keys fit it.
+CREATE TEMP TABLE numbers AS
+WITH RECURSIVE counter(n) AS (SELECT 1
+                              UNION ALL
+                              SELECT n + 1 FROM counter WHERE n < 40)
+SELECT n
+FROM counter;
 
-INSERT INTO category_codes (category)
-SELECT DISTINCT p_category
-FROM part
-ORDER BY p_category;
+CREATE TEMP TABLE nations
+(
+    nation TEXT,
+    region TEXT
+);
+
+INSERT INTO nations
+VALUES
+       ('ALGERIA', 'AFRICA'),
+       ('ARGENTINA', 'AMERICA'),
+       ('BRAZIL', 'AMERICA'),
+       ('CANADA', 'AMERICA'),
+       ('CHINA', 'ASIA'),
+       ('EGYPT', 'MIDDLE EAST'),
+       ('ETHIOPIA', 'AFRICA'),
+       ('FRANCE', 'EUROPE'),
+       ('GERMANY', 'EUROPE'),
+       ('INDIA', 'ASIA'),
+       ('INDONESIA', 'ASIA'),
+       ('IRAN', 'MIDDLE EAST'),
+       ('IRAQ', 'MIDDLE EAST'),
+       ('JAPAN', 'ASIA'),
+       ('JORDAN', 'MIDDLE EAST'),
+       ('KENYA', 'AFRICA'),
+       ('MOROCCO', 'AFRICA'),
+       ('MOZAMBIQUE', 'AFRICA'),
+       ('PERU', 'AMERICA'),
+       ('ROMANIA', 'EUROPE'),
+       ('RUSSIA', 'EUROPE'),
+       ('SAUDI ARABIA', 'MIDDLE EAST'),
+       ('UNITED KINGDOM', 'EUROPE'),
+       ('UNITED STATES', 'AMERICA'),
+       ('VIETNAM', 'ASIA');
+
+INSERT INTO mfgr_codes (mfgr_code, mfgr)
+SELECT ROW_NUMBER() OVER (ORDER BY p_mfgr), p_mfgr
+FROM (SELECT 'MFGR#' || n AS p_mfgr
+      FROM numbers
+      WHERE n <= 5
+      UNION
+      SELECT p_mfgr FROM part);
+
+INSERT INTO category_codes (category_code, category)
+SELECT ROW_NUMBER() OVER (ORDER BY p_category), p_category
+FROM (SELECT 'MFGR#' || m.n || c.n AS p_category
+      FROM numbers m,
+           numbers c
+      WHERE m.n <= 5
+        AND c.n <= 5
+      UNION
+      SELECT p_category FROM part);
 
-INSERT INTO brand1_codes (brand1)
-SELECT DISTINCT p_brand1
-FROM part
-ORDER BY p_brand1;
+INSERT INTO brand1_codes (brand1_code, brand1)
+SELECT ROW_NUMBER() OVER (ORDER BY p_brand1), p_brand1
+FROM (SELECT 'MFGR#' || m.n || c.n || b.n AS p_brand1
+      FROM numbers m,
+           numbers c,
+           numbers b
+      WHERE m.n <= 5
+        AND c.n <= 5
+      UNION
+      SELECT p_brand1 FROM part);
 
-INSERT INTO city_codes (city)
-SELECT s_city AS city
-FROM supplier
-UNION
-SELECT c_city AS city
-FROM customer
-ORDER BY city;
+-- dbgen's cities are their nation's name cut or padded to 9 characters, then
+-- a digit.
+INSERT INTO city_codes (city_code, city)
+SELECT ROW_NUMBER() OVER (ORDER BY city), city
+FROM (SELECT substr(nation || '         ', 1, 9) || (n - 1) AS city
+      FROM nations,
+           numbers
+      WHERE n <= 10
+      UNION
+      SELECT s_city AS city
+      FROM supplier
+      UNION
+      SELECT c_city AS city
+      FROM customer);
 
-INSERT INTO nation_codes (nation)
-SELECT s_nation AS nation
-FROM supplier
-UNION
-SELECT c_nation AS nation
-FROM customer
-ORDER BY nation;
+INSERT INTO nation_codes (nation_code, nation)
+SELECT ROW_NUMBER() OVER (ORDER BY nation), nation
+FROM (SELECT nation
+      FROM nations
+      UNION
+      SELECT s_nation AS nation
+      FROM supplier
+      UNION
+      SELECT c_nation AS nation
+      FROM customer);
 
-INSERT INTO region_codes (region)
-SELECT s_region AS region
-FROM supplier
-UNION
-SELECT c_region AS region
-FROM customer
-ORDER BY region;
+INSERT INTO region_codes (region_code, region)
+SELECT ROW_NUMBER() OVER (ORDER BY region), region
+FROM (SELECT region
+      FROM nations
+      UNION
+      SELECT s_region AS region
+      FROM supplier
+      UNION
+      SELECT c_region AS region
+      FROM customer);
 
-INSERT INTO yearmonth_codes (yearmonth)
-SELECT DISTINCT d_yearmonth
-FROM date
-ORDER BY d_yearmonth;
+INSERT INTO yearmonth_codes (yearmonth_code, yearmonth)
+SELECT ROW_NUMBER() OVER (ORDER BY d_yearmonth), d_yearmonth
+FROM (SELECT DISTINCT d_yearmonth FROM date);
 
 INSERT INTO part_encoded
 SELECT partkey,
@@ -0,0 +1,63 @@
+#include "query.hpp"
+
+#include <fstream>
+#include <stdexcept>
+
+void run_appends(const char *path, const char *tbl_path, size_t batch_rows) {
+  double latency;
+  Database db;
+
+  load_dimensions(path, db);
+  load_lineorder(path, db.lo);
+
+  std::vector<std::unique_ptr<Query>> qs;
+  std::vector<Accumulator> accs;
+  for (QueryFactory make : queries) {
+    qs.push_back(make(db));
+
+    Query &q = *qs.back();
+    q.build();
+
+    accs.emplace_back();
+    latency = time([&] { accs.back() = q.probe(db.lo); });
+
+    log(q.name, "Probe", latency);
+
+    q.finalize(accs.back());
+    q.print();
+  }
+
+  std::ifstream file;
+  if (std::string(tbl_path) != "-") {
+    file.open(tbl_path);
+    if (!file) {
+      throw std::runtime_error(std::string("cannot open ") + tbl_path);
+    }
+  }
+  std::istream &in = file.is_open() ? file : std::cin;
+
+  // Dimension tables are fixed, so the hash tables stay valid and only the
+  // new rows need probing.
+  Lineorder delta;
+  for (size_t batch = 0; read_lineorder_tbl(in, delta, batch_rows); ++batch) {
+    std::string append = "Append" + std::to_string(batch);
+
+    latency = time([&] { db.lo.append(delta); });
+
+    log(append, "Rows", delta.orderdate.size());
+    log(append, "Ingest", latency);
+
+    for (size_t i = 0; i < qs.size(); ++i) {
+      Query &q = *qs[i];
+
+      latency = time([&] {
+        accs[i] = agg_merge(std::move(accs[i]), q.probe(delta));
+        q.finalize(accs[i]);
+      });
+
+      log(q.name, append + "Refresh", latency);
+
+      q.print();
+    }
+  }
+}
@@ -0,0 +1,57 @@
+#include "common.hpp"
+
+#include "oneapi/tbb.h"
+
+#include <algorithm>
+#include <memory>
+
+// Passes over the buffer, the first of which may still fault pages in.
+constexpr size_t n_passes = 5;
+
+// Keeps the sums alive, so the compiler cannot drop the reads.
+volatile uint64_t bandwidth_sink;
+
+double measure_read_bandwidth(size_t bytes) {
+  size_t n = std::max<size_t>(1, bytes / sizeof(uint64_t));
+  std::unique_ptr<uint64_t[]> buffer(new uint64_t[n]);
+  tbb::blocked_range<size_t> range(0, n, 1 << 16);
+
+  // Written in parallel, so that the pages are spread as the reads will be.
+  tbb::parallel_for(range, [&](const tbb::blocked_range<size_t> &r) {
+    for (size_t i = r.begin(); i < r.end(); ++i) {
+      buffer[i] = i;
+    }
+  });
+
+  double best = 0;
+  for (size_t pass = 0; pass < n_passes; ++pass) {
+    uint64_t sum;
+    double latency = time([&] {
+      sum = tbb::parallel_reduce(
+          range,
+          uint64_t(0),
+          [&](const tbb::blocked_range<size_t> &r, uint64_t acc) {
+            for (size_t i = r.begin(); i < r.end(); ++i) {
+              acc += buffer[i];
+            }
+            return acc;
+          },
+          std::plus<>());
+    });
+    bandwidth_sink = sum;
+    best = std::max(best, n * sizeof(uint64_t) / latency);
+  }
+  return best;
+}
+
+void log_bandwidth(const std::string &query,
+                   const std::string &phase,
+                   size_t bytes,
+                   double latency) {
+  double bandwidth = bytes / latency;
+  log(query, phase + "ReadBytes", bytes);
+  log(query, phase + "GBps", bandwidth / 1e9);
+  if (peak_read_bandwidth > 0) {
+    log(query, phase + "PercentOfPeak", 100 * bandwidth / peak_read_bandwidth);
+  }
+}
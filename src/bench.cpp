@@ -0,0 +1,289 @@
+// Microbenchmarks of the primitives the queries are built from, on synthetic
+// columns, so that a change to one can be measured without loading a
+// database. Every kernel runs on one thread and logs its best time over the
+// repetitions, in nanoseconds per row.
+
+#include "common.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+
+// Rows a bulk probe looks up at a time.
+constexpr size_t block_size = 1024;
+
+// Keeps results alive, so the compiler cannot drop the loops computing them.
+volatile uint64_t sink;
+
+struct Options {
+  std::vector<size_t> sizes = {1 << 10, 1 << 16, 1 << 20, 1 << 24};
+  size_t rows = 1 << 24;
+  double selectivity = 0.5;
+  size_t repetitions = 5;
+};
+
+// Runs f repetitions times and logs the fastest run, per row.
+template <typename F>
+void bench(const Options &options,
+           const std::string &kernel,
+           size_t size,
+           size_t rows,
+           F &&f) {
+  double best = 0;
+  for (size_t r = 0; r < options.repetitions; ++r) {
+    double latency = time(f);
+    best = r == 0 ? latency : std::min(best, latency);
+  }
+
+  std::string name = kernel + "/" + std::to_string(size);
+  log(name, "Seconds", best);
+  log(name, "NsPerRow", best * 1e9 / rows);
+}
+
+// The keys 1..n in random order, dense like the dimension keys.
+std::vector<uint32_t> distinct_keys(size_t n, std::mt19937_64 &rng) {
+  std::vector<uint32_t> keys(n);
+  std::iota(keys.begin(), keys.end(), 1);
+  std::shuffle(keys.begin(), keys.end(), rng);
+  return keys;
+}
+
+// rows probe keys of which a fraction selectivity is in keys, which holds
+// the values 1..keys.size().
+std::vector<uint32_t> probe_keys(const std::vector<uint32_t> &keys,
+                                 size_t rows,
+                                 double selectivity,
+                                 std::mt19937_64 &rng) {
+  std::bernoulli_distribution hit(selectivity);
+  std::uniform_int_distribution<size_t> any(0, keys.size() - 1);
+  std::vector<uint32_t> probes(rows);
+  for (uint32_t &key : probes) {
+    key = keys[any(rng)];
+    if (!hit(rng)) {
+      key += keys.size();
+    }
+  }
+  return probes;
+}
+
+// Builds a set and a map of keys and probes them with probes, logging each
+// kernel under prefix, so that two table implementations compare directly.
+template <typename S, typename M>
+void bench_hash_table(const Options &options,
+                      const std::string &prefix,
+                      const std::vector<uint32_t> &keys,
+                      const std::vector<uint32_t> &probes) {
+  size_t size = keys.size();
+
+  S hs;
+  bench(options, prefix + "SetBuild", size, size, [&] {
+    hs = S();
+    for (uint32_t key : keys) {
+      hs.insert(key);
+    }
+  });
+
+  bench(options, prefix + "SetProbe", size, options.rows, [&] {
+    uint64_t hits = 0;
+    for (uint32_t key : probes) {
+      hits += hs.contains(key);
+    }
+    sink = hits;
+  });
+
+  M hm;
+  bench(options, prefix + "MapBuild", size, size, [&] {
+    hm = M();
+    for (uint32_t key : keys) {
+      hm.emplace(key, key);
+    }
+  });
+
+  bench(options, prefix + "MapProbe", size, options.rows, [&] {
+    uint64_t sum = 0;
+    for (uint32_t key : probes) {
+      auto it = hm.find(key);
+      if (it != hm.end()) {
+        sum += it->second;
+      }
+    }
+    sink = sum;
+  });
+}
+
+void bench_hash_tables(const Options &options, std::mt19937_64 &rng) {
+  for (size_t size : options.sizes) {
+    std::vector<uint32_t> keys = distinct_keys(size, rng);
+    std::vector<uint32_t> probes =
+        probe_keys(keys, options.rows, options.selectivity, rng);
+
+    bench_hash_table<hash_set<uint32_t>, hash_map<uint32_t, uint32_t>>(
+        options, "Hash", keys, probes);
+    bench_hash_table<absl::flat_hash_set<uint32_t>,
+                     absl::flat_hash_map<uint32_t, uint32_t>>(
+        options, "AbslHash", keys, probes);
+
+    // The bulk probe of a block of rows, as a join probes lineorder.
+    hash_map<uint32_t, uint32_t> hm;
+    for (uint32_t key : keys) {
+      hm.emplace(key, key);
+    }
+    std::vector<uint32_t> rows(block_size);
+    std::vector<uint32_t> payloads(block_size);
+    bench(options, "HashMapBulkProbe", size, options.rows, [&] {
+      uint64_t sum = 0;
+      for (size_t i = 0; i < probes.size(); i += block_size) {
+        size_t n = std::min(block_size, probes.size() - i);
+        size_t n_found = hm.probe(&probes[i], n, rows.data(), payloads.data());
+        for (size_t j = 0; j < n_found; ++j) {
+          sum += payloads[j];
+        }
+      }
+      sink = sum;
+    });
+  }
+}
+
+// The dense accumulator sizes of the queries' group-by keys.
+const size_t accumulator_sizes[] = {256, 512, 8192, 1 << 16};
+
+void bench_accumulators(const Options &options, std::mt19937_64 &rng) {
+  std::vector<uint32_t> values(options.rows);
+  for (uint32_t &value : values) {
+    value = rng() % 1000000;
+  }
+
+  for (size_t size : accumulator_sizes) {
+    std::vector<uint32_t> slots(options.rows);
+    for (uint32_t &slot : slots) {
+      slot = rng() % size;
+    }
+
+    Accumulator acc(size);
+    bench(options, "AccumulatorAdd", size, options.rows, [&] {
+      for (size_t i = 0; i < slots.size(); ++i) {
+        std::pair<bool, int64_t> &slot = acc[slots[i]];
+        slot.first = true;
+        slot.second += values[i];
+      }
+    });
+    sink = acc[0].second;
+
+    // Merges as many accumulators as a probe's tasks would, one per 64 Ki
+    // rows.
+    size_t n_merges = std::max<size_t>(1, options.rows >> 16);
+    Accumulator other = acc;
+    bench(options, "AggMerge", size, n_merges * size, [&] {
+      Accumulator merged(size);
+      for (size_t i = 0; i < n_merges; ++i) {
+        merged = agg_merge(std::move(merged), other);
+      }
+      sink = merged[0].second;
+    });
+  }
+}
+
+void bench_partition_scatter(const Options &options, std::mt19937_64 &rng) {
+  for (size_t size : options.sizes) {
+    std::vector<uint32_t> keys = distinct_keys(size, rng);
+    std::vector<uint32_t> scattered(size);
+
+    bench(options, "PartitionScatter", size, size, [&] {
+      std::vector<uint32_t> offsets(n_pt + 1);
+      for (uint32_t key : keys) {
+        ++offsets[key % n_pt + 1];
+      }
+      std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+      for (uint32_t key : keys) {
+        scattered[offsets[key % n_pt]++] = key;
+      }
+    });
+    sink = scattered[0];
+  }
+}
+
+// Q1.1's filter and sum over lineorder columns drawn so that a fraction
+// selectivity of rows passes.
+void bench_q1_filter(const Options &options, std::mt19937_64 &rng) {
+  std::bernoulli_distribution pass(options.selectivity);
+  std::vector<uint8_t> discount(options.rows);
+  std::vector<uint8_t> quantity(options.rows);
+  std::vector<uint32_t> extendedprice(options.rows);
+  for (size_t i = 0; i < options.rows; ++i) {
+    bool p = pass(rng);
+    discount[i] = p ? 1 + rng() % 3 : 4 + rng() % 7;
+    quantity[i] = 1 + rng() % 50;
+    if (p && quantity[i] >= 25) {
+      quantity[i] = 1 + rng() % 24;
+    }
+    extendedprice[i] = rng() % 10000000;
+  }
+
+  bench(options, "Q1Filter", options.rows, options.rows, [&] {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < options.rows; ++i) {
+      if (discount[i] >= 1 && discount[i] <= 3 && quantity[i] < 25) {
+        sum += extendedprice[i] * discount[i];
+      }
+    }
+    sink = sum;
+  });
+}
+
+int usage(const char *argv0) {
+  std::cerr << "USAGE: " << std::endl;
+  std::cerr << argv0 << " [OPTION]" << std::endl;
+  std::cerr << std::endl;
+  std::cerr << "OPTIONS: " << std::endl;
+  std::cerr << "  --sizes N,...       hash table and scatter sizes"
+            << std::endl;
+  std::cerr << "  --rows N            rows probed, added or filtered"
+            << std::endl;
+  std::cerr << "  --selectivity S     fraction of probes that hit and of rows"
+            << std::endl;
+  std::cerr << "                      that pass the filter (default 0.5)"
+            << std::endl;
+  std::cerr << "  --repetitions N     runs of each kernel, fastest kept"
+            << std::endl;
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  Options options;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--sizes" && i + 1 < argc) {
+      options.sizes.clear();
+      std::istringstream in(argv[++i]);
+      std::string size;
+      while (std::getline(in, size, ',')) {
+        options.sizes.push_back(std::stoul(size));
+      }
+    } else if (arg == "--rows" && i + 1 < argc) {
+      options.rows = std::stoul(argv[++i]);
+    } else if (arg == "--selectivity" && i + 1 < argc) {
+      options.selectivity = std::stod(argv[++i]);
+    } else if (arg == "--repetitions" && i + 1 < argc) {
+      options.repetitions = std::stoul(argv[++i]);
+    } else {
+      return usage(argv[0]);
+    }
+  }
+
+  if (options.rows == 0 || options.repetitions == 0 ||
+      std::count(options.sizes.begin(), options.sizes.end(), 0) > 0) {
+    return usage(argv[0]);
+  }
+
+  std::mt19937_64 rng(1);
+  bench_hash_tables(options, rng);
+  bench_accumulators(options, rng);
+  bench_partition_scatter(options, rng);
+  bench_q1_filter(options, rng);
+
+  return 0;
+}
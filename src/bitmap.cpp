@@ -0,0 +1,306 @@
+#include "bitmap.hpp"
+#include "query.hpp"
+
+#include "oneapi/tbb.h"
+
+#include <algorithm>
+#include <iterator>
+
+// Largest container stored as an array; a bitset takes as many bytes.
+constexpr size_t max_array = 4096;
+
+constexpr size_t n_words = (size_t(1) << 16) / 64;
+
+void Bitmap::Container::push_back(uint16_t low) {
+  ++cardinality;
+  if (dense()) {
+    bits[low >> 6] |= uint64_t(1) << (low & 63);
+    return;
+  }
+  array.push_back(low);
+  if (array.size() > max_array) {
+    to_bits();
+  }
+}
+
+void Bitmap::Container::to_bits() {
+  bits.assign(n_words, 0);
+  for (uint16_t low : array) {
+    bits[low >> 6] |= uint64_t(1) << (low & 63);
+  }
+  array = std::vector<uint16_t>();
+}
+
+void Bitmap::Container::to_array() {
+  std::vector<uint16_t> values;
+  values.reserve(cardinality);
+  for (size_t w = 0; w < bits.size(); ++w) {
+    for (uint64_t word = bits[w]; word != 0; word &= word - 1) {
+      values.push_back(uint16_t(w * 64 + __builtin_ctzll(word)));
+    }
+  }
+  array = std::move(values);
+  bits = std::vector<uint64_t>();
+}
+
+Bitmap::Container Bitmap::Container::intersect(const Container &a,
+                                               const Container &b) {
+  Container c;
+
+  if (a.dense() && b.dense()) {
+    c.bits.resize(n_words);
+    for (size_t w = 0; w < n_words; ++w) {
+      c.bits[w] = a.bits[w] & b.bits[w];
+      c.cardinality += __builtin_popcountll(c.bits[w]);
+    }
+    if (c.cardinality <= max_array) {
+      c.to_array();
+    }
+    return c;
+  }
+
+  if (!a.dense() && !b.dense()) {
+    std::set_intersection(a.array.begin(),
+                          a.array.end(),
+                          b.array.begin(),
+                          b.array.end(),
+                          std::back_inserter(c.array));
+  } else {
+    const Container &sparse = a.dense() ? b : a;
+    const Container &dense = a.dense() ? a : b;
+    for (uint16_t low : sparse.array) {
+      if (dense.bits[low >> 6] & (uint64_t(1) << (low & 63))) {
+        c.array.push_back(low);
+      }
+    }
+  }
+
+  c.cardinality = c.array.size();
+  return c;
+}
+
+Bitmap::Container Bitmap::Container::unite(const Container &a,
+                                           const Container &b) {
+  Container c;
+
+  if (!a.dense() && !b.dense()) {
+    std::set_union(a.array.begin(),
+                   a.array.end(),
+                   b.array.begin(),
+                   b.array.end(),
+                   std::back_inserter(c.array));
+    c.cardinality = c.array.size();
+    if (c.array.size() > max_array) {
+      c.to_bits();
+    }
+    return c;
+  }
+
+  const Container &other = a.dense() ? b : a;
+  c.bits = a.dense() ? a.bits : b.bits;
+  if (other.dense()) {
+    for (size_t w = 0; w < n_words; ++w) {
+      c.bits[w] |= other.bits[w];
+    }
+  } else {
+    for (uint16_t low : other.array) {
+      c.bits[low >> 6] |= uint64_t(1) << (low & 63);
+    }
+  }
+  for (uint64_t word : c.bits) {
+    c.cardinality += __builtin_popcountll(word);
+  }
+  return c;
+}
+
+void Bitmap::push_back(uint32_t row) {
+  uint16_t high = row >> 16;
+  if (keys.empty() || keys.back() != high) {
+    keys.push_back(high);
+    containers.emplace_back();
+  }
+  containers.back().push_back(uint16_t(row));
+}
+
+size_t Bitmap::size() const {
+  size_t n = 0;
+  for (const Container &c : containers) {
+    n += c.cardinality;
+  }
+  return n;
+}
+
+size_t Bitmap::bytes() const {
+  size_t n = keys.capacity() * sizeof(uint16_t) +
+             containers.capacity() * sizeof(Container);
+  for (const Container &c : containers) {
+    n += c.array.capacity() * sizeof(uint16_t) +
+         c.bits.capacity() * sizeof(uint64_t);
+  }
+  return n;
+}
+
+Bitmap &Bitmap::operator|=(const Bitmap &b) {
+  Bitmap c;
+  size_t i = 0;
+  size_t j = 0;
+  while (i < keys.size() || j < b.keys.size()) {
+    if (j == b.keys.size() || (i < keys.size() && keys[i] < b.keys[j])) {
+      c.keys.push_back(keys[i]);
+      c.containers.push_back(std::move(containers[i++]));
+    } else if (i == keys.size() || b.keys[j] < keys[i]) {
+      c.keys.push_back(b.keys[j]);
+      c.containers.push_back(b.containers[j++]);
+    } else {
+      c.keys.push_back(keys[i]);
+      c.containers.push_back(Container::unite(containers[i++],
+                                              b.containers[j++]));
+    }
+  }
+  return *this = std::move(c);
+}
+
+Bitmap operator&(const Bitmap &a, const Bitmap &b) {
+  Bitmap c;
+  size_t i = 0;
+  size_t j = 0;
+  while (i < a.keys.size() && j < b.keys.size()) {
+    if (a.keys[i] < b.keys[j]) {
+      ++i;
+    } else if (b.keys[j] < a.keys[i]) {
+      ++j;
+    } else {
+      Bitmap::Container container =
+          Bitmap::Container::intersect(a.containers[i++], b.containers[j++]);
+      if (container.cardinality > 0) {
+        c.keys.push_back(a.keys[i - 1]);
+        c.containers.push_back(std::move(container));
+      }
+    }
+  }
+  return c;
+}
+
+size_t BitmapIndex::bytes() const {
+  size_t n = 0;
+  for (const BitmapColumn *column : {&d_year,
+                                     &d_yearmonthnum,
+                                     &d_yearmonth,
+                                     &c_city,
+                                     &c_nation,
+                                     &c_region,
+                                     &s_city,
+                                     &s_nation,
+                                     &s_region,
+                                     &p_mfgr,
+                                     &p_category,
+                                     &p_brand1,
+                                     &lo_discount,
+                                     &lo_quantity}) {
+    for (const auto &[value, bitmap] : *column) {
+      n += bitmap.bytes();
+    }
+  }
+  return n;
+}
+
+// Adds each lineorder row to the bitmaps of the attribute values of the
+// dimension row its foreign key references. Each attribute is a (column,
+// bitmaps) pair.
+template <typename... Attributes>
+void index_dimension(const std::vector<uint32_t> &foreign_keys,
+                     const std::vector<uint32_t> &keys,
+                     Attributes... attributes) {
+  hash_map<uint32_t, uint32_t> key_rows = rows(keys);
+  for (size_t i = 0; i < foreign_keys.size(); ++i) {
+    uint32_t row = key_rows.find(foreign_keys[i])->second;
+    ((std::get<1>(attributes)[std::get<0>(attributes)[row]].push_back(i)),
+     ...);
+  }
+}
+
+BitmapIndex build_bitmap_index(const Database &db) {
+  BitmapIndex index;
+  const Lineorder &lo = db.lo;
+
+  tbb::parallel_invoke(
+      [&] {
+        index_dimension(lo.orderdate,
+                        db.d.datekey,
+                        std::tie(db.d.year, index.d_year),
+                        std::tie(db.d.yearmonthnum, index.d_yearmonthnum),
+                        std::tie(db.d.yearmonth, index.d_yearmonth));
+      },
+      [&] {
+        index_dimension(lo.custkey,
+                        db.c.custkey,
+                        std::tie(db.c.city, index.c_city),
+                        std::tie(db.c.nation, index.c_nation),
+                        std::tie(db.c.region, index.c_region));
+      },
+      [&] {
+        index_dimension(lo.suppkey,
+                        db.s.suppkey,
+                        std::tie(db.s.city, index.s_city),
+                        std::tie(db.s.nation, index.s_nation),
+                        std::tie(db.s.region, index.s_region));
+      },
+      [&] {
+        index_dimension(lo.partkey,
+                        db.p.partkey,
+                        std::tie(db.p.mfgr, index.p_mfgr),
+                        std::tie(db.p.category, index.p_category),
+                        std::tie(db.p.brand1, index.p_brand1));
+      },
+      [&] {
+        for (size_t i = 0; i < lo.orderdate.size(); ++i) {
+          index.lo_discount[lo.discount[i]].push_back(i);
+          index.lo_quantity[lo.quantity[i]].push_back(i);
+        }
+      });
+
+  return index;
+}
+
+Lineorder gather(const Lineorder &lo, const Bitmap &rows) {
+  Lineorder result;
+  rows.for_each([&](uint32_t i) { result.push_back(lo, i); });
+  return result;
+}
+
+void run_bitmaps(const char *path) {
+  double latency;
+  Database db;
+  BitmapIndex index;
+
+  load_dimensions(path, db);
+  load_lineorder(path, db.lo);
+
+  latency = time([&] { index = build_bitmap_index(db); });
+
+  log("Bitmaps", "Build", latency);
+  log("Bitmaps", "Bytes", index.bytes());
+
+  for (QueryFactory make : queries) {
+    std::unique_ptr<Query> q = make(db);
+    q->build();
+
+    Accumulator acc;
+    latency = time([&] { acc = q->probe(db.lo); });
+
+    log(q->name, "Probe", latency);
+
+    Bitmap rows;
+    latency = time([&] { rows = q->filter(index); });
+
+    log(q->name, "BitmapFilter", latency);
+    log(q->name, "BitmapRows", rows.size());
+
+    latency = time([&] { acc = q->probe(gather(db.lo, rows)); });
+
+    log(q->name, "BitmapProbe", latency);
+
+    q->finalize(acc);
+    q->print();
+  }
+}
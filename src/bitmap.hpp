@@ -0,0 +1,118 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <tuple>
+
+// A compressed set of row ids. Rows sharing their high 16 bits are stored in
+// one container, as a sorted array of their low bits while sparse and as a
+// bitset once dense, as in Roaring bitmaps.
+class Bitmap {
+public:
+  // Adds row, which must be greater than every row already in the set.
+  void push_back(uint32_t row);
+
+  size_t size() const;
+
+  size_t bytes() const;
+
+  Bitmap &operator|=(const Bitmap &b);
+
+  friend Bitmap operator&(const Bitmap &a, const Bitmap &b);
+
+  // Calls f(row) for every row in ascending order.
+  template <typename F> void for_each(F &&f) const {
+    for (size_t i = 0; i < keys.size(); ++i) {
+      uint32_t high = uint32_t(keys[i]) << 16;
+      const Container &c = containers[i];
+      if (!c.dense()) {
+        for (uint16_t low : c.array) {
+          f(high | low);
+        }
+        continue;
+      }
+      for (size_t w = 0; w < c.bits.size(); ++w) {
+        for (uint64_t word = c.bits[w]; word != 0; word &= word - 1) {
+          f(high | uint32_t(w * 64 + __builtin_ctzll(word)));
+        }
+      }
+    }
+  }
+
+private:
+  struct Container {
+    std::vector<uint16_t> array;
+    std::vector<uint64_t> bits;
+    uint32_t cardinality = 0;
+
+    bool dense() const { return !bits.empty(); }
+
+    void push_back(uint16_t low);
+    void to_bits();
+    void to_array();
+
+    static Container intersect(const Container &a, const Container &b);
+    static Container unite(const Container &a, const Container &b);
+  };
+
+  std::vector<uint16_t> keys;
+  std::vector<Container> containers;
+};
+
+// Bitmaps of one attribute, by value.
+using BitmapColumn = hash_map<uint32_t, Bitmap>;
+
+// Bitmap join indexes: for each value of a dimension attribute, the lineorder
+// rows whose dimension row has it. Discount and quantity are indexed too.
+struct BitmapIndex {
+  BitmapColumn d_year;
+  BitmapColumn d_yearmonthnum;
+  BitmapColumn d_yearmonth;
+  BitmapColumn c_city;
+  BitmapColumn c_nation;
+  BitmapColumn c_region;
+  BitmapColumn s_city;
+  BitmapColumn s_nation;
+  BitmapColumn s_region;
+  BitmapColumn p_mfgr;
+  BitmapColumn p_category;
+  BitmapColumn p_brand1;
+  BitmapColumn lo_discount;
+  BitmapColumn lo_quantity;
+
+  size_t bytes() const;
+};
+
+BitmapIndex build_bitmap_index(const Database &db);
+
+// Copies the rows of lo in rows.
+Lineorder gather(const Lineorder &lo, const Bitmap &rows);
+
+// Union of the bitmaps of the values that satisfy pred.
+template <typename F> Bitmap select(const BitmapColumn &bitmaps, F &&pred) {
+  Bitmap result;
+  for (const auto &[value, bitmap] : bitmaps) {
+    if (pred(value)) {
+      result |= bitmap;
+    }
+  }
+  return result;
+}
+
+// Union of the bitmaps of the values column takes in the dimension rows
+// where pred holds. Includes every qualifying lineorder row, and is exact
+// when pred depends on nothing finer than column.
+template <typename T, typename F>
+Bitmap select(const BitmapColumn &bitmaps,
+              const std::vector<T> &column,
+              F &&pred) {
+  hash_set<uint32_t> values;
+  for (size_t i = 0; i < column.size(); ++i) {
+    if (pred(i)) {
+      values.insert(column[i]);
+    }
+  }
+  return select(bitmaps, [&](uint32_t value) {
+    return values.contains(value);
+  });
+}
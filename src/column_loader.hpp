@@ -0,0 +1,60 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Loads the columns of a database on demand, each at most once, so that a run
+// reads only the columns its queries use. Columns are read on a background
+// thread in the order they are requested: prefetch() queues them, and load()
+// queues them and waits. Part and customer columns are stored in partition
+// order, so requesting any of them also loads the table's key.
+class ColumnLoader {
+public:
+  // Loads the dictionaries, which query constructors read, before returning.
+  ColumnLoader(const char *path, Database &db);
+
+  ColumnLoader(const ColumnLoader &) = delete;
+  ColumnLoader &operator=(const ColumnLoader &) = delete;
+
+  // Waits for the column being read, if any, and drops the rest of the queue.
+  ~ColumnLoader();
+
+  // Queues the columns of set not loaded or queued yet.
+  void prefetch(ColumnSet set);
+
+  // Returns once every column of set is loaded, rethrowing any error raised
+  // while reading.
+  void load(ColumnSet set);
+
+  ColumnSet loaded() const;
+
+private:
+  void work();
+
+  // Reads the columns of set, one statement per table.
+  void read(ColumnSet set);
+
+  std::string path;
+  Database &db;
+
+  // The permutations that put the rows of p and c in partition order, kept
+  // to apply to their columns read later.
+  std::vector<uint32_t> p_order;
+  std::vector<uint32_t> c_order;
+
+  mutable std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<ColumnSet> queue;
+  ColumnSet queued = 0;
+  ColumnSet loaded_set = 0;
+  std::exception_ptr error;
+  bool stopping = false;
+  std::thread worker;
+};
@@ -1,17 +1,41 @@
 #pragma once
 
+#include "dictionary.hpp"
+#include "int_hash.hpp"
+
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 
 #include <chrono>
+#include <cstdint>
 #include <iostream>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 using Accumulator = std::vector<std::pair<bool, int64_t>>;
 
-template <typename K> using hash_set = absl::flat_hash_set<K>;
-template <typename K, typename V> using hash_map = absl::flat_hash_map<K, V>;
+// Hash tables are absl's, except that tables of 32-bit keys with at most
+// 32-bit integer payloads, those of the joins, are IntHashTables.
+template <typename K> struct HashSetOf {
+  using type = absl::flat_hash_set<K>;
+};
+
+template <> struct HashSetOf<uint32_t> {
+  using type = IntHashSet;
+};
+
+template <typename K, typename V> struct HashMapOf {
+  using type = std::conditional_t<std::is_same_v<K, uint32_t> &&
+                                      std::is_integral_v<V> && sizeof(V) <= 4,
+                                  IntHashMap<V>,
+                                  absl::flat_hash_map<K, V>>;
+};
+
+template <typename K> using hash_set = typename HashSetOf<K>::type;
+template <typename K, typename V>
+using hash_map = typename HashMapOf<K, V>::type;
 
 // Number of hash table partitions.
 constexpr size_t n_pt = 256;
@@ -43,6 +67,48 @@ void log(const std::string &query, const std::string &key, T &&value) {
   std::cerr << query << ',' << key << ',' << value << std::endl;
 }
 
+template <typename... T>
+size_t column_bytes(const std::vector<T> &...columns) {
+  return ((columns.size() * sizeof(T)) + ... + 0);
+}
+
+// Bytes an absl table has allocated: a slot and a control byte per bucket,
+// plus the control bytes cloned past the end for 16-wide group probes.
+template <typename K>
+size_t allocated_bytes(const absl::flat_hash_set<K> &table) {
+  return table.capacity() == 0 ? 0 : table.capacity() * (sizeof(K) + 1) + 16;
+}
+
+template <typename K, typename V>
+size_t allocated_bytes(const absl::flat_hash_map<K, V> &table) {
+  using slot = typename absl::flat_hash_map<K, V>::value_type;
+  return table.capacity() == 0 ? 0
+                               : table.capacity() * (sizeof(slot) + 1) + 16;
+}
+
+template <typename V> size_t allocated_bytes(const IntHashTable<V> &table) {
+  return table.bytes();
+}
+
+template <typename T> constexpr bool is_hash_table = false;
+template <typename K>
+constexpr bool is_hash_table<absl::flat_hash_set<K>> = true;
+template <typename K, typename V>
+constexpr bool is_hash_table<absl::flat_hash_map<K, V>> = true;
+template <typename V> constexpr bool is_hash_table<IntHashTable<V>> = true;
+
+// Bytes a vector has allocated, including unused capacity and, for a
+// partitioned table, its partitions.
+template <typename T> size_t allocated_bytes(const std::vector<T> &values) {
+  size_t n = values.capacity() * sizeof(T);
+  if constexpr (is_hash_table<T>) {
+    for (const T &table : values) {
+      n += allocated_bytes(table);
+    }
+  }
+  return n;
+}
+
 struct Part {
   std::vector<uint32_t> partkey;
   std::vector<uint8_t> mfgr;
@@ -82,6 +148,105 @@ struct Lineorder {
   std::vector<uint8_t> discount;
   std::vector<uint32_t> revenue;
   std::vector<uint32_t> supplycost;
+
+  // Bytes of one row across the columns.
+  static constexpr size_t row_bytes =
+      sizeof(uint32_t) * 7 + sizeof(uint8_t) * 2;
+
+  void clear() {
+    custkey.clear();
+    partkey.clear();
+    suppkey.clear();
+    orderdate.clear();
+    quantity.clear();
+    extendedprice.clear();
+    discount.clear();
+    revenue.clear();
+    supplycost.clear();
+  }
+
+  void reserve(size_t n_rows) {
+    custkey.reserve(n_rows);
+    partkey.reserve(n_rows);
+    suppkey.reserve(n_rows);
+    orderdate.reserve(n_rows);
+    quantity.reserve(n_rows);
+    extendedprice.reserve(n_rows);
+    discount.reserve(n_rows);
+    revenue.reserve(n_rows);
+    supplycost.reserve(n_rows);
+  }
+
+  // Appends row i of rows.
+  void push_back(const Lineorder &rows, size_t i) {
+    custkey.push_back(rows.custkey[i]);
+    partkey.push_back(rows.partkey[i]);
+    suppkey.push_back(rows.suppkey[i]);
+    orderdate.push_back(rows.orderdate[i]);
+    quantity.push_back(rows.quantity[i]);
+    extendedprice.push_back(rows.extendedprice[i]);
+    discount.push_back(rows.discount[i]);
+    revenue.push_back(rows.revenue[i]);
+    supplycost.push_back(rows.supplycost[i]);
+  }
+
+  void append(const Lineorder &rows) {
+    auto extend = [](auto &column, const auto &values) {
+      column.insert(column.end(), values.begin(), values.end());
+    };
+    extend(custkey, rows.custkey);
+    extend(partkey, rows.partkey);
+    extend(suppkey, rows.suppkey);
+    extend(orderdate, rows.orderdate);
+    extend(quantity, rows.quantity);
+    extend(extendedprice, rows.extendedprice);
+    extend(discount, rows.discount);
+    extend(revenue, rows.revenue);
+    extend(supplycost, rows.supplycost);
+  }
+};
+
+// Dimension attributes of each lineorder row, joined in by foreign key.
+struct LineorderDims {
+  std::vector<uint16_t> d_year;
+  std::vector<uint32_t> d_yearmonthnum;
+  std::vector<uint32_t> d_yearmonth;
+  std::vector<uint8_t> d_weeknuminyear;
+  std::vector<uint8_t> c_city;
+  std::vector<uint8_t> c_nation;
+  std::vector<uint8_t> c_region;
+  std::vector<uint8_t> s_city;
+  std::vector<uint8_t> s_nation;
+  std::vector<uint8_t> s_region;
+  std::vector<uint8_t> p_mfgr;
+  std::vector<uint8_t> p_category;
+  std::vector<uint16_t> p_brand1;
+
+  size_t bytes() const {
+    return column_bytes(d_year,
+                        d_yearmonthnum,
+                        d_yearmonth,
+                        d_weeknuminyear,
+                        c_city,
+                        c_nation,
+                        c_region,
+                        s_city,
+                        s_nation,
+                        s_region,
+                        p_mfgr,
+                        p_category,
+                        p_brand1);
+  }
+};
+
+// Row ranges of a table stored in partition order: partition i holds rows
+// [begin(i), end(i)), those whose key % n_pt is i.
+struct Partitions {
+  std::vector<uint32_t> offsets;
+
+  size_t begin(size_t i) const { return offsets[i]; }
+  size_t end(size_t i) const { return offsets[i + 1]; }
+  size_t size(size_t i) const { return end(i) - begin(i); }
 };
 
 struct Database {
@@ -90,11 +255,73 @@ struct Database {
   Customer c;
   Date d;
   Lineorder lo;
+  LineorderDims lo_dims;
+  Dictionaries dicts;
 
-  std::vector<Part> p_pt;
-  std::vector<Customer> c_pt;
+  // Partitions of p and c, whose rows are stored in partition order.
+  Partitions p_pt;
+  Partitions c_pt;
 };
 
+// A set of the columns of a Database, one bit each, so that a run loads only
+// the columns its queries read.
+using ColumnSet = uint32_t;
+
+namespace col {
+constexpr ColumnSet p_partkey = 1u << 0;
+constexpr ColumnSet p_mfgr = 1u << 1;
+constexpr ColumnSet p_category = 1u << 2;
+constexpr ColumnSet p_brand1 = 1u << 3;
+constexpr ColumnSet s_suppkey = 1u << 4;
+constexpr ColumnSet s_city = 1u << 5;
+constexpr ColumnSet s_nation = 1u << 6;
+constexpr ColumnSet s_region = 1u << 7;
+constexpr ColumnSet c_custkey = 1u << 8;
+constexpr ColumnSet c_city = 1u << 9;
+constexpr ColumnSet c_nation = 1u << 10;
+constexpr ColumnSet c_region = 1u << 11;
+constexpr ColumnSet d_datekey = 1u << 12;
+constexpr ColumnSet d_year = 1u << 13;
+constexpr ColumnSet d_yearmonthnum = 1u << 14;
+constexpr ColumnSet d_yearmonth = 1u << 15;
+constexpr ColumnSet d_weeknuminyear = 1u << 16;
+constexpr ColumnSet lo_custkey = 1u << 17;
+constexpr ColumnSet lo_partkey = 1u << 18;
+constexpr ColumnSet lo_suppkey = 1u << 19;
+constexpr ColumnSet lo_orderdate = 1u << 20;
+constexpr ColumnSet lo_quantity = 1u << 21;
+constexpr ColumnSet lo_extendedprice = 1u << 22;
+constexpr ColumnSet lo_discount = 1u << 23;
+constexpr ColumnSet lo_revenue = 1u << 24;
+constexpr ColumnSet lo_supplycost = 1u << 25;
+
+constexpr ColumnSet part = p_partkey | p_mfgr | p_category | p_brand1;
+constexpr ColumnSet customer = c_custkey | c_city | c_nation | c_region;
+} // namespace col
+
+// Maps each key to its row.
+inline hash_map<uint32_t, uint32_t> rows(const std::vector<uint32_t> &keys) {
+  hash_map<uint32_t, uint32_t> rows;
+  rows.reserve(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    rows.emplace(keys[i], i);
+  }
+  return rows;
+}
+
+// The row of key in rows of table. Throws if there is none, such as for a
+// lineorder foreign key without its dimension row.
+inline uint32_t row_of(const hash_map<uint32_t, uint32_t> &rows,
+                       const char *table,
+                       uint32_t key) {
+  auto it = rows.find(key);
+  if (it == rows.end()) {
+    throw std::runtime_error("no " + std::string(table) + " row for key " +
+                             std::to_string(key));
+  }
+  return it->second;
+}
+
 template <typename F> double time(F &&f) {
   auto t0 = std::chrono::high_resolution_clock::now();
   f();
@@ -102,16 +329,89 @@ template <typename F> double time(F &&f) {
   return std::chrono::duration<double>(t1 - t0).count();
 }
 
-void q1p1(const Database &db);
-void q1p2(const Database &db);
-void q1p3(const Database &db);
-void q2p1(const Database &db);
-void q2p2(const Database &db);
-void q2p3(const Database &db);
-void q3p1(const Database &db);
-void q3p2(const Database &db);
-void q3p3(const Database &db);
-void q3p4(const Database &db);
-void q4p1(const Database &db);
-void q4p2(const Database &db);
-void q4p3(const Database &db);
+// Resets the peak resident set size, so that peak_rss() covers only what runs
+// after. A no-op outside Linux, where the peak is the process's.
+void reset_peak_rss();
+
+// Peak resident set size in bytes.
+size_t peak_rss();
+
+// Logs the bytes each column and partition offset array of db has allocated.
+void log_memory(const Database &db);
+
+// Measures the sustained bandwidth of reading a buffer of the given size with
+// every thread, in bytes per second, as the best of a few passes.
+double measure_read_bandwidth(size_t bytes);
+
+// The read bandwidth phases are compared with, or 0 if unmeasured.
+inline double peak_read_bandwidth = 0;
+
+// Logs the bytes a phase of a query read in latency seconds, the bandwidth it
+// achieved in GB/s and, if measured, its percentage of peak_read_bandwidth.
+void log_bandwidth(const std::string &query,
+                   const std::string &phase,
+                   size_t bytes,
+                   double latency);
+
+// Loads the dictionaries of the encoded dimension columns.
+void load_dictionaries(const char *path, Database &db);
+
+// Reorders the rows of part and customer into partition order.
+void partition_dimensions(Database &db);
+
+// Loads the dimension tables, with part and customer in partition order, and
+// the dictionaries of their encoded columns.
+void load_dimensions(const char *path, Database &db);
+
+// Generates SSB data at scale factor sf directly into db, encoded and in
+// partition order as if loaded, from seed alone. With zipf > 0, lineorder's
+// custkey, partkey, suppkey and orderdate follow a Zipf distribution of that
+// exponent instead of a uniform one.
+void generate(Database &db, double sf, double zipf, uint64_t seed);
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+// Reads the lineorder rows whose rowid is in [rowid_begin, rowid_end)
+// sequentially, in chunks.
+class LineorderReader {
+public:
+  explicit LineorderReader(const char *path,
+                           int64_t rowid_begin = 0,
+                           int64_t rowid_end = INT64_MAX);
+
+  LineorderReader(const LineorderReader &) = delete;
+  LineorderReader &operator=(const LineorderReader &) = delete;
+
+  ~LineorderReader();
+
+  // Replaces the contents of lo with the next n_rows rows, or fewer at the
+  // end. Returns false once no rows are left. A bounded n_rows is reserved
+  // up front, so that filling lo never reallocates its columns.
+  bool read(Lineorder &lo, size_t n_rows);
+
+private:
+  sqlite3 *db;
+  sqlite3_stmt *stmt;
+  bool done = false;
+};
+
+// Loads the lineorder rows whose rowid is in [rowid_begin, rowid_end).
+void load_lineorder(const char *path,
+                    Lineorder &lo,
+                    int64_t rowid_begin = 0,
+                    int64_t rowid_end = INT64_MAX);
+
+// Replaces the contents of lo with the next n_rows rows, or fewer at the end,
+// of a lineorder table in dbgen's '|'-separated format. Returns false once no
+// rows are left.
+bool read_lineorder_tbl(std::istream &in, Lineorder &lo, size_t n_rows);
+
+// Writes all size bytes of data to fd, retrying short writes.
+void write_all(int fd, const void *data, size_t size);
+
+// Fills db.lo_dims from the dimension rows each lineorder row references.
+void denormalize(Database &db);
+
+// Returns the half-open range of lineorder rowids.
+std::pair<int64_t, int64_t> lineorder_rowids(const char *path);
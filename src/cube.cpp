@@ -0,0 +1,233 @@
+#include "cube.hpp"
+#include "query.hpp"
+
+#include "oneapi/tbb.h"
+
+#include <algorithm>
+#include <numeric>
+
+template <typename... T>
+Classes partition(const std::vector<T> &...columns) {
+  Classes classes;
+  hash_map<std::tuple<T...>, uint32_t> ids;
+
+  size_t n_rows = std::get<0>(std::tie(columns...)).size();
+  classes.of.reserve(n_rows);
+  for (size_t i = 0; i < n_rows; ++i) {
+    auto it = ids.try_emplace(std::make_tuple(columns[i]...), ids.size()).first;
+    classes.of.push_back(it->second);
+  }
+
+  classes.size = ids.size();
+  return classes;
+}
+
+Cube make_cube(std::vector<size_t> shape) {
+  Cube cube;
+  size_t size = std::accumulate(
+      shape.begin(), shape.end(), size_t(1), std::multiplies<>());
+  cube.shape = std::move(shape);
+  cube.sums.resize(size);
+  cube.present.resize(size);
+  return cube;
+}
+
+// Lineorder rows grouped by date row: those of date row d are rows[begin[d]]
+// to rows[begin[d + 1]].
+struct RowsByDate {
+  std::vector<size_t> begin;
+  std::vector<uint32_t> rows;
+};
+
+RowsByDate rows_by_date(const Database &db) {
+  hash_map<uint32_t, uint32_t> d_rows = rows(db.d.datekey);
+  const Lineorder &lo = db.lo;
+
+  std::vector<uint32_t> d(lo.orderdate.size());
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, d.size()),
+                    [&](const tbb::blocked_range<size_t> &r) {
+                      for (size_t i = r.begin(); i < r.end(); ++i) {
+                        d[i] = row_of(d_rows, "date", lo.orderdate[i]);
+                      }
+                    });
+
+  // A counting sort by date row.
+  RowsByDate by_date;
+  by_date.begin.assign(db.d.datekey.size() + 1, 0);
+  for (uint32_t row : d) {
+    ++by_date.begin[row + 1];
+  }
+  std::partial_sum(
+      by_date.begin.begin(), by_date.begin.end(), by_date.begin.begin());
+
+  std::vector<size_t> next(by_date.begin.begin(), by_date.begin.end() - 1);
+  by_date.rows.resize(d.size());
+  for (size_t i = 0; i < d.size(); ++i) {
+    by_date.rows[next[d[i]]++] = i;
+  }
+  return by_date;
+}
+
+// Adds value(i) to cube for every lineorder row i, at cell(i) within the
+// slice of its leading dimension, a class of dates. Each slice is filled by
+// one task, from the rows of its dates, so no two tasks add to the same cell.
+template <typename Cell, typename Value>
+void fill(Cube &cube,
+          const Classes &dates,
+          const RowsByDate &by_date,
+          Cell &&cell,
+          Value &&value) {
+  std::vector<std::vector<uint32_t>> dates_of(dates.size);
+  for (size_t d = 0; d < dates.of.size(); ++d) {
+    dates_of[dates.of[d]].push_back(d);
+  }
+
+  tbb::parallel_for(size_t(0), dates.size, [&](size_t k) {
+    size_t slice = k * (cube.sums.size() / dates.size);
+    for (uint32_t d : dates_of[k]) {
+      for (size_t j = by_date.begin[d]; j < by_date.begin[d + 1]; ++j) {
+        size_t i = by_date.rows[j];
+        size_t offset = slice + cell(i);
+        cube.sums[offset] += value(i);
+        cube.present[offset] = 1;
+      }
+    }
+  });
+}
+
+Cubes build_cubes(const Database &db) {
+  Cubes cubes;
+
+  cubes.d_year = partition(db.d.year);
+  cubes.d_yearmonth = partition(db.d.yearmonth);
+  cubes.d_week = partition(db.d.yearmonthnum, db.d.weeknuminyear);
+  cubes.s_region = partition(db.s.region);
+  cubes.s_nation = partition(db.s.nation);
+  cubes.s_city = partition(db.s.city);
+  cubes.c_nation = partition(db.c.nation);
+  cubes.c_city = partition(db.c.city);
+  cubes.p_category = partition(db.p.category);
+  cubes.p_brand1 = partition(db.p.brand1);
+
+  size_t n_discount = 0;
+  size_t n_quantity = 0;
+  if (!db.lo.orderdate.empty()) {
+    n_discount = *std::max_element(db.lo.discount.begin(),
+                                   db.lo.discount.end()) +
+                 1;
+    n_quantity = *std::max_element(db.lo.quantity.begin(),
+                                   db.lo.quantity.end()) +
+                 1;
+  }
+
+  cubes.q1 = make_cube({cubes.d_week.size, n_discount, n_quantity});
+  cubes.q2 = make_cube(
+      {cubes.d_year.size, cubes.s_region.size, cubes.p_brand1.size});
+  cubes.q3 = make_cube(
+      {cubes.d_yearmonth.size, cubes.c_city.size, cubes.s_city.size});
+  cubes.q4 = make_cube({cubes.d_year.size,
+                        cubes.c_nation.size,
+                        cubes.s_nation.size,
+                        cubes.p_category.size});
+
+  RowsByDate by_date = rows_by_date(db);
+  hash_map<uint32_t, uint32_t> s_rows = rows(db.s.suppkey);
+  hash_map<uint32_t, uint32_t> c_rows = rows(db.c.custkey);
+  hash_map<uint32_t, uint32_t> p_rows = rows(db.p.partkey);
+
+  const Lineorder &lo = db.lo;
+  auto s_row = [&](size_t i) {
+    return row_of(s_rows, "supplier", lo.suppkey[i]);
+  };
+  auto c_row = [&](size_t i) {
+    return row_of(c_rows, "customer", lo.custkey[i]);
+  };
+  auto p_row = [&](size_t i) { return row_of(p_rows, "part", lo.partkey[i]); };
+
+  // Q2's and Q4's cubes lead with only 7 years, so the four fill together to
+  // keep every thread busy.
+  tbb::parallel_invoke(
+      [&] {
+        fill(
+            cubes.q1,
+            cubes.d_week,
+            by_date,
+            [&](size_t i) {
+              return lo.discount[i] * n_quantity + lo.quantity[i];
+            },
+            [&](size_t i) { return lo.extendedprice[i] * lo.discount[i]; });
+      },
+      [&] {
+        fill(
+            cubes.q2,
+            cubes.d_year,
+            by_date,
+            [&](size_t i) {
+              return cubes.s_region.of[s_row(i)] * cubes.p_brand1.size +
+                     cubes.p_brand1.of[p_row(i)];
+            },
+            [&](size_t i) { return lo.revenue[i]; });
+      },
+      [&] {
+        fill(
+            cubes.q3,
+            cubes.d_yearmonth,
+            by_date,
+            [&](size_t i) {
+              return cubes.c_city.of[c_row(i)] * cubes.s_city.size +
+                     cubes.s_city.of[s_row(i)];
+            },
+            [&](size_t i) { return lo.revenue[i]; });
+      },
+      [&] {
+        fill(
+            cubes.q4,
+            cubes.d_year,
+            by_date,
+            [&](size_t i) {
+              return (cubes.c_nation.of[c_row(i)] * cubes.s_nation.size +
+                      cubes.s_nation.of[s_row(i)]) *
+                         cubes.p_category.size +
+                     cubes.p_category.of[p_row(i)];
+            },
+            [&](size_t i) { return lo.revenue[i] - lo.supplycost[i]; });
+      });
+
+  return cubes;
+}
+
+void run_cubes(const char *path) {
+  double latency;
+  Database db;
+  Cubes cubes;
+
+  load_dimensions(path, db);
+  load_lineorder(path, db.lo);
+
+  latency = time([&] { cubes = build_cubes(db); });
+
+  log("Cubes", "Build", latency);
+  log("Cubes", "Bytes", cubes.bytes());
+
+  for (QueryFactory make : queries) {
+    std::unique_ptr<Query> q = make(db);
+    q->build();
+
+    Accumulator acc;
+    bool covered;
+    latency = time([&] { covered = q->rollup(cubes, acc); });
+
+    if (covered) {
+      log(q->name, "Rollup", latency);
+    } else {
+      latency = time([&] { acc = q->probe(db.lo); });
+      log(q->name, "Probe", latency);
+    }
+
+    latency = time([&] { q->finalize(acc); });
+
+    log(q->name, "Finalize", latency);
+
+    q->print();
+  }
+}
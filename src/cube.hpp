@@ -0,0 +1,133 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <climits>
+#include <tuple>
+
+// A partition of a dimension table's rows into classes that agree on some
+// attributes.
+struct Classes {
+  // Class of each row.
+  std::vector<uint32_t> of;
+  size_t size = 0;
+};
+
+// Sums of a lineorder measure, grouped by dimension classes and small
+// lineorder columns, in row-major order.
+struct Cube {
+  std::vector<size_t> shape;
+  std::vector<int64_t> sums;
+  std::vector<uint8_t> present;
+
+  size_t bytes() const {
+    return sums.size() * sizeof(int64_t) + present.size() * sizeof(uint8_t);
+  }
+};
+
+struct Cubes {
+  Classes d_year;
+  Classes d_yearmonth;
+  Classes d_week;
+  Classes s_region;
+  Classes s_nation;
+  Classes s_city;
+  Classes c_nation;
+  Classes c_city;
+  Classes p_category;
+  Classes p_brand1;
+
+  // sum(extendedprice * discount) by d_week, discount and quantity.
+  Cube q1;
+  // sum(revenue) by d_year, s_region and p_brand1.
+  Cube q2;
+  // sum(revenue) by d_yearmonth, c_city and s_city.
+  Cube q3;
+  // sum(revenue - supplycost) by d_year, c_nation, s_nation and p_category.
+  Cube q4;
+
+  size_t bytes() const {
+    return q1.bytes() + q2.bytes() + q3.bytes() + q4.bytes();
+  }
+};
+
+Cubes build_cubes(const Database &db);
+
+// Value of a class whose rows are all filtered out.
+constexpr int32_t filtered = -1;
+
+// Sets values[k] to the value lookup(key) returns for every row of class k,
+// which is either filtered or a group-by code. Returns false if the rows of
+// some class disagree, i.e. the query depends on finer attributes than the
+// classes keep.
+template <typename F>
+bool classify(const std::vector<uint32_t> &keys,
+              const Classes &classes,
+              F &&lookup,
+              std::vector<int32_t> &values) {
+  constexpr int32_t unset = INT32_MIN;
+
+  values.assign(classes.size, unset);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    int32_t value = lookup(keys[i]);
+    int32_t &class_value = values[classes.of[i]];
+    if (class_value == unset) {
+      class_value = value;
+    } else if (class_value != value) {
+      return false;
+    }
+  }
+
+  for (int32_t &value : values) {
+    if (value == unset) {
+      value = filtered;
+    }
+  }
+
+  return true;
+}
+
+// Lookups for classify() over a query's dimension hash tables.
+template <typename Set> int32_t member(const Set &hs, uint32_t key) {
+  return hs.contains(key) ? 0 : filtered;
+}
+
+template <typename Map> int32_t value(const Map &hm, uint32_t key) {
+  auto it = hm.find(key);
+  return it == hm.end() ? filtered : int32_t(it->second);
+}
+
+// Values of a lineorder column dimension, which are their own codes.
+inline std::vector<int32_t> codes(size_t n) {
+  std::vector<int32_t> values(n);
+  for (size_t i = 0; i < n; ++i) {
+    values[i] = int32_t(i);
+  }
+  return values;
+}
+
+// Calls add(codes, sum) for every non-empty cell of cube whose values are not
+// filtered in any dimension, where codes holds the cell's value in each.
+template <typename F>
+void rollup(const Cube &cube,
+            const std::vector<std::vector<int32_t>> &values,
+            F &&add) {
+  std::vector<int32_t> cell_codes(values.size());
+
+  auto visit = [&](auto &self, size_t dim, size_t offset) -> void {
+    if (dim == values.size()) {
+      if (cube.present[offset]) {
+        add(cell_codes.data(), cube.sums[offset]);
+      }
+      return;
+    }
+    for (size_t k = 0; k < cube.shape[dim]; ++k) {
+      if (values[dim][k] != filtered) {
+        cell_codes[dim] = values[dim][k];
+        self(self, dim + 1, offset * cube.shape[dim] + k);
+      }
+    }
+  };
+
+  visit(visit, 0, 0);
+}
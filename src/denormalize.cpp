@@ -0,0 +1,91 @@
+#include "query.hpp"
+
+#include "oneapi/tbb.h"
+
+void denormalize(Database &db) {
+  const Lineorder &lo = db.lo;
+  LineorderDims &dims = db.lo_dims;
+  size_t n_rows = lo.orderdate.size();
+
+  dims.d_year.resize(n_rows);
+  dims.d_yearmonthnum.resize(n_rows);
+  dims.d_yearmonth.resize(n_rows);
+  dims.d_weeknuminyear.resize(n_rows);
+  dims.c_city.resize(n_rows);
+  dims.c_nation.resize(n_rows);
+  dims.c_region.resize(n_rows);
+  dims.s_city.resize(n_rows);
+  dims.s_nation.resize(n_rows);
+  dims.s_region.resize(n_rows);
+  dims.p_mfgr.resize(n_rows);
+  dims.p_category.resize(n_rows);
+  dims.p_brand1.resize(n_rows);
+
+  hash_map<uint32_t, uint32_t> d_rows = rows(db.d.datekey);
+  hash_map<uint32_t, uint32_t> c_rows = rows(db.c.custkey);
+  hash_map<uint32_t, uint32_t> s_rows = rows(db.s.suppkey);
+  hash_map<uint32_t, uint32_t> p_rows = rows(db.p.partkey);
+
+  tbb::parallel_for(
+      tbb::blocked_range<size_t>(0, n_rows),
+      [&](const tbb::blocked_range<size_t> &r) {
+        for (size_t i = r.begin(); i < r.end(); ++i) {
+          uint32_t d = row_of(d_rows, "date", lo.orderdate[i]);
+          dims.d_year[i] = db.d.year[d];
+          dims.d_yearmonthnum[i] = db.d.yearmonthnum[d];
+          dims.d_yearmonth[i] = db.d.yearmonth[d];
+          dims.d_weeknuminyear[i] = db.d.weeknuminyear[d];
+
+          uint32_t c = row_of(c_rows, "customer", lo.custkey[i]);
+          dims.c_city[i] = db.c.city[c];
+          dims.c_nation[i] = db.c.nation[c];
+          dims.c_region[i] = db.c.region[c];
+
+          uint32_t s = row_of(s_rows, "supplier", lo.suppkey[i]);
+          dims.s_city[i] = db.s.city[s];
+          dims.s_nation[i] = db.s.nation[s];
+          dims.s_region[i] = db.s.region[s];
+
+          uint32_t p = row_of(p_rows, "part", lo.partkey[i]);
+          dims.p_mfgr[i] = db.p.mfgr[p];
+          dims.p_category[i] = db.p.category[p];
+          dims.p_brand1[i] = db.p.brand1[p];
+        }
+      });
+}
+
+void run_denormalized(const char *path) {
+  double latency;
+  Database db;
+
+  load_dimensions(path, db);
+  load_lineorder(path, db.lo);
+
+  latency = time([&] { denormalize(db); });
+
+  log("Denormalize", "Build", latency);
+  log("Denormalize", "Bytes", db.lo_dims.bytes());
+
+  for (QueryFactory make : queries) {
+    std::unique_ptr<Query> q = make(db);
+    Accumulator acc;
+
+    // The build logs its own phases, so that Probe compares with Scan alone.
+    q->build();
+
+    latency = time([&] { acc = q->probe(db.lo); });
+
+    log(q->name, "Probe", latency);
+
+    q->finalize(acc);
+    q->print();
+
+    latency = time([&] { acc = q->scan(db.lo, db.lo_dims); });
+
+    log(q->name, "Scan", latency);
+    log(q->name, "ScanBytes", q->scan_bytes(db.lo_dims));
+
+    q->finalize(acc);
+    q->print();
+  }
+}
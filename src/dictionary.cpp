@@ -0,0 +1,47 @@
+#include "dictionary.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+Dictionary::Dictionary(const std::string &name,
+                       const std::vector<uint32_t> &codes,
+                       std::vector<std::string> values)
+    : first_code(codes.empty() ? 0 : codes.front()), values(std::move(values)) {
+  for (size_t i = 1; i < codes.size(); ++i) {
+    if (codes[i] != codes[i - 1] + 1 ||
+        !(this->values[i - 1] < this->values[i])) {
+      throw std::runtime_error(name + " dictionary is not order-preserving");
+    }
+  }
+}
+
+CodeRange Dictionary::equal(const std::string &value) const {
+  auto range = std::equal_range(values.begin(), values.end(), value);
+  return codes(range.first, range.second);
+}
+
+CodeRange Dictionary::between(const std::string &low,
+                              const std::string &high) const {
+  auto begin = std::lower_bound(values.begin(), values.end(), low);
+  auto end = std::upper_bound(begin, values.end(), high);
+  return codes(begin, end);
+}
+
+CodeRange Dictionary::prefix(const std::string &prefix) const {
+  auto begin = std::lower_bound(values.begin(), values.end(), prefix);
+  auto end = std::partition_point(begin, values.end(), [&](const auto &v) {
+    return v.compare(0, prefix.size(), prefix) == 0;
+  });
+  return codes(begin, end);
+}
+
+const std::string &Dictionary::value(uint32_t code) const {
+  return values.at(code - first_code);
+}
+
+CodeRange
+Dictionary::codes(std::vector<std::string>::const_iterator begin,
+                  std::vector<std::string>::const_iterator end) const {
+  uint32_t first = first_code + uint32_t(begin - values.begin());
+  return {first, first + uint32_t(end - begin)};
+}
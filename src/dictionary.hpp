@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A half-open range of dictionary codes.
+struct CodeRange {
+  uint32_t begin = 0;
+  uint32_t end = 0;
+
+  // A single unsigned comparison, so loops over code columns vectorize.
+  bool contains(uint32_t code) const { return code - begin < end - begin; }
+
+  bool empty() const { return begin == end; }
+
+  friend bool operator==(const CodeRange &a, const CodeRange &b) {
+    return a.begin == b.begin && a.end == b.end;
+  }
+};
+
+// An order-preserving dictionary: codes are consecutive and follow the order
+// of the values they encode, so string predicates become code ranges.
+class Dictionary {
+public:
+  Dictionary() = default;
+
+  // Throws unless the codes are consecutive and the values strictly
+  // increasing in code order.
+  Dictionary(const std::string &name,
+             const std::vector<uint32_t> &codes,
+             std::vector<std::string> values);
+
+  // Codes of the values equal to value.
+  CodeRange equal(const std::string &value) const;
+
+  // Codes of the values in [low, high], like SQL's BETWEEN.
+  CodeRange between(const std::string &low, const std::string &high) const;
+
+  // Codes of the values starting with prefix, like SQL's LIKE 'prefix%'.
+  CodeRange prefix(const std::string &prefix) const;
+
+  const std::string &value(uint32_t code) const;
+
+private:
+  CodeRange codes(std::vector<std::string>::const_iterator begin,
+                  std::vector<std::string>::const_iterator end) const;
+
+  uint32_t first_code = 0;
+  std::vector<std::string> values;
+};
+
+struct Dictionaries {
+  Dictionary mfgr;
+  Dictionary category;
+  Dictionary brand1;
+  Dictionary city;
+  Dictionary nation;
+  Dictionary region;
+  Dictionary yearmonth;
+};
@@ -0,0 +1,318 @@
+#include "common.hpp"
+
+#include "oneapi/tbb.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+// The nations of dbgen and the regions they are in.
+const std::pair<const char *, const char *> nations[] = {
+    {"ALGERIA", "AFRICA"},
+    {"ARGENTINA", "AMERICA"},
+    {"BRAZIL", "AMERICA"},
+    {"CANADA", "AMERICA"},
+    {"EGYPT", "MIDDLE EAST"},
+    {"ETHIOPIA", "AFRICA"},
+    {"FRANCE", "EUROPE"},
+    {"GERMANY", "EUROPE"},
+    {"INDIA", "ASIA"},
+    {"INDONESIA", "ASIA"},
+    {"IRAN", "MIDDLE EAST"},
+    {"IRAQ", "MIDDLE EAST"},
+    {"JAPAN", "ASIA"},
+    {"JORDAN", "MIDDLE EAST"},
+    {"KENYA", "AFRICA"},
+    {"MOROCCO", "AFRICA"},
+    {"MOZAMBIQUE", "AFRICA"},
+    {"PERU", "AMERICA"},
+    {"CHINA", "ASIA"},
+    {"ROMANIA", "EUROPE"},
+    {"SAUDI ARABIA", "MIDDLE EAST"},
+    {"VIETNAM", "ASIA"},
+    {"RUSSIA", "EUROPE"},
+    {"UNITED KINGDOM", "EUROPE"},
+    {"UNITED STATES", "AMERICA"}};
+
+const char *months[] = {"Jan",
+                        "Feb",
+                        "Mar",
+                        "Apr",
+                        "May",
+                        "Jun",
+                        "Jul",
+                        "Aug",
+                        "Sep",
+                        "Oct",
+                        "Nov",
+                        "Dec"};
+
+// Orders generated per task, each with its own random stream, so the data
+// depends only on the seed and not on the number of threads.
+constexpr size_t orders_per_block = 1 << 14;
+
+// The last order date dbgen draws, 151 days before the end of the calendar.
+constexpr uint32_t last_orderdate = 19980802;
+
+// The dictionary of a column with the given values, numbered from 1 in
+// sorted order as sql/load.sql numbers them, and each value's code.
+struct Encoding {
+  Dictionary dict;
+  hash_map<std::string, uint32_t> codes;
+
+  Encoding(const std::string &name, std::vector<std::string> values) {
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+
+    std::vector<uint32_t> numbers(values.size());
+    std::iota(numbers.begin(), numbers.end(), 1);
+    for (size_t i = 0; i < values.size(); ++i) {
+      codes[values[i]] = numbers[i];
+    }
+    dict = Dictionary(name, numbers, std::move(values));
+  }
+};
+
+// dbgen's city of a nation: its name cut or padded to 9 characters, then a
+// digit.
+std::string city_of(const std::string &nation, int digit) {
+  std::string city = nation.substr(0, 9);
+  city.resize(9, ' ');
+  return city + char('0' + digit);
+}
+
+// Draws keys from a set, uniformly or, with a positive Zipf exponent, with
+// probability proportional to 1 / rank^zipf over a random ranking of the
+// keys, so that the hot keys scatter over the key space and the partitions.
+class KeyDistribution {
+public:
+  KeyDistribution(std::vector<uint32_t> keys, double zipf, uint64_t seed)
+      : keys(std::move(keys)) {
+    if (zipf <= 0) {
+      return;
+    }
+
+    std::mt19937_64 rng(seed);
+    std::shuffle(this->keys.begin(), this->keys.end(), rng);
+
+    cdf.resize(this->keys.size());
+    double sum = 0;
+    for (size_t i = 0; i < cdf.size(); ++i) {
+      sum += std::pow(double(i + 1), -zipf);
+      cdf[i] = sum;
+    }
+    for (double &p : cdf) {
+      p /= sum;
+    }
+  }
+
+  template <typename R> uint32_t operator()(R &rng) const {
+    size_t rank;
+    if (cdf.empty()) {
+      rank = std::uniform_int_distribution<size_t>(0, keys.size() - 1)(rng);
+    } else {
+      double u = std::uniform_real_distribution<double>(0, 1)(rng);
+      rank = std::upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+    }
+    return keys[std::min(rank, keys.size() - 1)];
+  }
+
+private:
+  std::vector<uint32_t> keys;
+  std::vector<double> cdf;
+};
+
+std::vector<uint32_t> key_range(size_t n) {
+  std::vector<uint32_t> keys(n);
+  std::iota(keys.begin(), keys.end(), 1);
+  return keys;
+}
+
+// dbgen's retail price of a part, in cents.
+uint32_t retail_price(uint32_t partkey) {
+  return 90000 + (partkey / 10) % 20001 + 100 * (partkey % 1000);
+}
+
+void generate_part(Database &db, size_t n, std::mt19937_64 &rng) {
+  std::vector<std::string> mfgrs;
+  std::vector<std::string> categories;
+  std::vector<std::string> brands;
+  for (int m = 1; m <= 5; ++m) {
+    mfgrs.push_back("MFGR#" + std::to_string(m));
+    for (int c = 1; c <= 5; ++c) {
+      categories.push_back(mfgrs.back() + std::to_string(c));
+      for (int b = 1; b <= 40; ++b) {
+        brands.push_back(categories.back() + std::to_string(b));
+      }
+    }
+  }
+
+  Encoding mfgr("mfgr", mfgrs);
+  Encoding category("category", categories);
+  Encoding brand1("brand1", brands);
+
+  std::uniform_int_distribution<int> one_to_five(1, 5);
+  std::uniform_int_distribution<int> one_to_forty(1, 40);
+  for (uint32_t partkey = 1; partkey <= n; ++partkey) {
+    std::string m = "MFGR#" + std::to_string(one_to_five(rng));
+    std::string c = m + std::to_string(one_to_five(rng));
+    std::string b = c + std::to_string(one_to_forty(rng));
+    db.p.partkey.push_back(partkey);
+    db.p.mfgr.push_back(mfgr.codes[m]);
+    db.p.category.push_back(category.codes[c]);
+    db.p.brand1.push_back(brand1.codes[b]);
+  }
+
+  db.dicts.mfgr = std::move(mfgr.dict);
+  db.dicts.category = std::move(category.dict);
+  db.dicts.brand1 = std::move(brand1.dict);
+}
+
+// Generates suppliers and customers, which draw their geography alike.
+void generate_places(Database &db,
+                     size_t n_suppliers,
+                     size_t n_customers,
+                     std::mt19937_64 &rng) {
+  std::vector<std::string> cities;
+  std::vector<std::string> nation_names;
+  std::vector<std::string> regions;
+  for (const auto &[nation, region] : nations) {
+    nation_names.push_back(nation);
+    regions.push_back(region);
+    for (int digit = 0; digit < 10; ++digit) {
+      cities.push_back(city_of(nation, digit));
+    }
+  }
+
+  Encoding city("city", cities);
+  Encoding nation("nation", nation_names);
+  Encoding region("region", regions);
+
+  std::uniform_int_distribution<size_t> any_nation(0, std::size(nations) - 1);
+  std::uniform_int_distribution<int> any_digit(0, 9);
+  auto place = [&](auto &table) {
+    const auto &[n, r] = nations[any_nation(rng)];
+    table.city.push_back(city.codes[city_of(n, any_digit(rng))]);
+    table.nation.push_back(nation.codes[n]);
+    table.region.push_back(region.codes[r]);
+  };
+
+  for (uint32_t suppkey = 1; suppkey <= n_suppliers; ++suppkey) {
+    db.s.suppkey.push_back(suppkey);
+    place(db.s);
+  }
+  for (uint32_t custkey = 1; custkey <= n_customers; ++custkey) {
+    db.c.custkey.push_back(custkey);
+    place(db.c);
+  }
+
+  db.dicts.city = std::move(city.dict);
+  db.dicts.nation = std::move(nation.dict);
+  db.dicts.region = std::move(region.dict);
+}
+
+// Generates every day from 1992 to 1998, numbering weeks from January 1st.
+void generate_date(Database &db) {
+  const int days_in_month[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+  std::vector<std::string> yearmonths;
+  for (int year = 1992; year <= 1998; ++year) {
+    for (const char *month : months) {
+      yearmonths.push_back(month + std::to_string(year));
+    }
+  }
+  Encoding yearmonth("yearmonth", yearmonths);
+
+  for (int year = 1992; year <= 1998; ++year) {
+    bool leap = year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+    int day_in_year = 0;
+    for (int month = 1; month <= 12; ++month) {
+      int n_days = days_in_month[month - 1] + (month == 2 && leap);
+      for (int day = 1; day <= n_days; ++day, ++day_in_year) {
+        db.d.datekey.push_back(year * 10000 + month * 100 + day);
+        db.d.year.push_back(year);
+        db.d.yearmonthnum.push_back(year * 100 + month);
+        db.d.yearmonth.push_back(
+            yearmonth.codes[months[month - 1] + std::to_string(year)]);
+        db.d.weeknuminyear.push_back(day_in_year / 7 + 1);
+      }
+    }
+  }
+
+  db.dicts.yearmonth = std::move(yearmonth.dict);
+}
+
+void generate(Database &db, double sf, double zipf, uint64_t seed) {
+  if (!(sf > 0)) {
+    throw std::runtime_error("scale factor must be positive");
+  }
+
+  auto scaled = [&](double n) { return std::max<size_t>(1, size_t(n * sf)); };
+  size_t n_parts =
+      sf < 1 ? scaled(200000)
+             : size_t(200000 * (1 + std::floor(std::log2(sf))));
+  size_t n_suppliers = scaled(2000);
+  size_t n_customers = scaled(30000);
+  size_t n_orders = scaled(1500000);
+
+  std::mt19937_64 rng(seed);
+  generate_part(db, n_parts, rng);
+  generate_places(db, n_suppliers, n_customers, rng);
+  generate_date(db);
+
+  std::vector<uint32_t> orderdates;
+  for (uint32_t datekey : db.d.datekey) {
+    if (datekey <= last_orderdate) {
+      orderdates.push_back(datekey);
+    }
+  }
+
+  KeyDistribution custkey(key_range(n_customers), zipf, seed + 1);
+  KeyDistribution partkey(key_range(n_parts), zipf, seed + 2);
+  KeyDistribution suppkey(key_range(n_suppliers), zipf, seed + 3);
+  KeyDistribution orderdate(std::move(orderdates), zipf, seed + 4);
+
+  size_t n_blocks = (n_orders + orders_per_block - 1) / orders_per_block;
+  std::vector<Lineorder> blocks(n_blocks);
+
+  tbb::parallel_for(size_t(0), n_blocks, [&](size_t block) {
+    std::seed_seq block_seed{seed, uint64_t(block)};
+    std::mt19937_64 rng(block_seed);
+    std::uniform_int_distribution<int> n_lines(1, 7);
+    std::uniform_int_distribution<int> quantity(1, 50);
+    std::uniform_int_distribution<int> discount(0, 10);
+
+    Lineorder &lo = blocks[block];
+    size_t end = std::min(n_orders, (block + 1) * orders_per_block);
+    for (size_t order = block * orders_per_block; order < end; ++order) {
+      uint32_t c = custkey(rng);
+      uint32_t d = orderdate(rng);
+      for (int line = n_lines(rng); line > 0; --line) {
+        uint32_t p = partkey(rng);
+        uint32_t q = quantity(rng);
+        uint32_t x = discount(rng);
+        uint32_t price = q * retail_price(p);
+
+        lo.custkey.push_back(c);
+        lo.partkey.push_back(p);
+        lo.suppkey.push_back(suppkey(rng));
+        lo.orderdate.push_back(d);
+        lo.quantity.push_back(q);
+        lo.extendedprice.push_back(price);
+        lo.discount.push_back(x);
+        lo.revenue.push_back(uint64_t(price) * (100 - x) / 100);
+        lo.supplycost.push_back(6 * retail_price(p) / 10);
+      }
+    }
+  });
+
+  for (Lineorder &block : blocks) {
+    db.lo.append(block);
+    block = Lineorder();
+  }
+
+  partition_dimensions(db);
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <cassert>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+
+// Largest packed key, in bits, that is aggregated into a dense Accumulator.
+// Wider keys fall back to a hash table.
+constexpr size_t max_dense_bits = 16;
+
+using HashAccumulator = hash_map<uint64_t, int64_t>;
+
+constexpr size_t bit_width(uint64_t x) {
+  size_t n = 0;
+  for (; x != 0; x >>= 1) {
+    ++n;
+  }
+  return n;
+}
+
+// A group-by column whose codes lie in [Min, Max].
+template <typename T, T Min, T Max> struct Dim {
+  static_assert(Min <= Max);
+
+  using type = T;
+
+  static constexpr T min = Min;
+  static constexpr T max = Max;
+
+  static constexpr size_t bits = bit_width(uint64_t(Max - Min));
+
+  static uint64_t encode(T value) {
+    assert(value >= Min && value <= Max);
+    return uint64_t(value - Min);
+  }
+
+  static T decode(uint64_t code) { return T(code + Min); }
+};
+
+// Throws unless D covers every code in range: a query's key fixes its group-by
+// domain at compile time, while the dictionary of the loaded database decides
+// which codes the matching values have.
+template <typename D> void check_domain(const CodeRange &range) {
+  if (range.empty() || range.begin < D::min || range.end - 1 > D::max) {
+    throw std::runtime_error("group-by codes [" + std::to_string(range.begin) +
+                             ", " + std::to_string(range.end) +
+                             ") outside key domain [" + std::to_string(D::min) +
+                             ", " + std::to_string(D::max) + "]");
+  }
+}
+
+// Packs the codes of several group-by columns into a single slot index, with
+// the first column in the most significant bits.
+template <typename... Ds> struct GroupKey {
+  static constexpr size_t bits = (Ds::bits + ... + 0);
+  static constexpr bool dense = bits <= max_dense_bits;
+  static constexpr size_t size = dense ? size_t(1) << bits : 0;
+  static constexpr size_t bytes = size * sizeof(Accumulator::value_type);
+
+  using accumulator =
+      std::conditional_t<dense, Accumulator, HashAccumulator>;
+
+  static uint64_t pack(typename Ds::type... values) {
+    uint64_t key = 0;
+    ((key = (key << Ds::bits) | Ds::encode(values)), ...);
+    return key;
+  }
+
+  static std::tuple<typename Ds::type...> unpack(uint64_t key) {
+    return unpack(key, std::index_sequence_for<Ds...>());
+  }
+
+  static accumulator make() {
+    if constexpr (dense) {
+      return Accumulator(size);
+    } else {
+      return HashAccumulator();
+    }
+  }
+
+  static void add(accumulator &acc, uint64_t key, int64_t value) {
+    if constexpr (dense) {
+      std::pair<bool, int64_t> &slot = acc[key];
+      slot.first = true;
+      slot.second += value;
+    } else {
+      acc[key] += value;
+    }
+  }
+
+  static accumulator merge(accumulator a, const accumulator &b) {
+    if constexpr (dense) {
+      return agg_merge(std::move(a), b);
+    } else {
+      for (const auto &[key, value] : b) {
+        a[key] += value;
+      }
+      return a;
+    }
+  }
+
+  // Appends one row per non-empty group, constructed from the decoded column
+  // values followed by the aggregate.
+  template <typename Row>
+  static void decode(const accumulator &acc, std::vector<Row> &result) {
+    auto emplace = [&](uint64_t key, int64_t value) {
+      std::apply(
+          [&](auto... values) { result.emplace_back(values..., value); },
+          unpack(key));
+    };
+
+    if constexpr (dense) {
+      for (size_t i = 0; i < acc.size(); ++i) {
+        if (acc[i].first) {
+          emplace(i, acc[i].second);
+        }
+      }
+    } else {
+      for (const auto &[key, value] : acc) {
+        emplace(key, value);
+      }
+    }
+  }
+
+private:
+  // Bit offset of the I-th column within the packed key.
+  template <size_t I> static constexpr size_t offset() {
+    constexpr size_t widths[] = {Ds::bits..., 0};
+    size_t s = 0;
+    for (size_t j = I + 1; j < sizeof...(Ds); ++j) {
+      s += widths[j];
+    }
+    return s;
+  }
+
+  template <size_t... I>
+  static std::tuple<typename Ds::type...> unpack(uint64_t key,
+                                                 std::index_sequence<I...>) {
+    return {Ds::decode((key >> offset<I>()) &
+                       ((uint64_t(1) << Ds::bits) - 1))...};
+  }
+};
@@ -0,0 +1,82 @@
+#include "hash_agg.hpp"
+
+#include <algorithm>
+
+size_t GroupSums::size() const {
+  size_t n = 0;
+  for (const auto &slot : dense) {
+    n += slot.first;
+  }
+  for (const HashAccumulator &table : partitions) {
+    n += table.size();
+  }
+  return n;
+}
+
+size_t GroupSums::bytes() const {
+  return allocated_bytes(dense) + allocated_bytes(partitions);
+}
+
+// Whether a ranks before b: by descending sum, then ascending key.
+bool ranks_before(const Group &a, const Group &b) {
+  return a.second > b.second || (a.second == b.second && a.first < b.first);
+}
+
+// Keeps the k best-ranked groups offered, in a heap whose front is the worst
+// kept.
+class TopK {
+public:
+  explicit TopK(size_t k) : k(k) {}
+
+  void offer(const Group &group) {
+    if (heap.size() < k) {
+      heap.push_back(group);
+      std::push_heap(heap.begin(), heap.end(), ranks_before);
+    } else if (k > 0 && ranks_before(group, heap.front())) {
+      std::pop_heap(heap.begin(), heap.end(), ranks_before);
+      heap.back() = group;
+      std::push_heap(heap.begin(), heap.end(), ranks_before);
+    }
+  }
+
+  // The groups kept, best first.
+  std::vector<Group> sorted() {
+    std::sort_heap(heap.begin(), heap.end(), ranks_before);
+    return std::move(heap);
+  }
+
+private:
+  size_t k;
+  std::vector<Group> heap;
+};
+
+std::vector<Group> top_k(const GroupSums &sums, size_t k) {
+  TopK top(k);
+
+  if (sums.is_dense()) {
+    for (size_t key = 0; key < sums.dense.size(); ++key) {
+      if (sums.dense[key].first) {
+        top.offer({key, sums.dense[key].second});
+      }
+    }
+    return top.sorted();
+  }
+
+  // Each partition picks its own k best, so only n_radix * k candidates are
+  // ranked against each other.
+  std::vector<std::vector<Group>> candidates(sums.partitions.size());
+  tbb::parallel_for(size_t(0), sums.partitions.size(), [&](size_t p) {
+    TopK partition_top(k);
+    for (const auto &[key, value] : sums.partitions[p]) {
+      partition_top.offer({key, value});
+    }
+    candidates[p] = partition_top.sorted();
+  });
+
+  for (const std::vector<Group> &groups : candidates) {
+    for (const Group &group : groups) {
+      top.offer(group);
+    }
+  }
+  return top.sorted();
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "group_key.hpp"
+#include "trace.hpp"
+
+#include "oneapi/tbb.h"
+
+#include <cassert>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Aggregation by a key with too many distinct values for a GroupKey, such as
+// a lineorder foreign key.
+
+// A group's key and sum.
+using Group = std::pair<uint64_t, int64_t>;
+
+// Number of radix partitions hash aggregation spills into and merges
+// independently of each other.
+constexpr size_t n_radix = 64;
+
+// Groups a thread pre-aggregates before spilling them, few enough for its
+// table to stay in the L2 cache.
+constexpr size_t max_local_groups = size_t(1) << 14;
+
+inline uint64_t mix(uint64_t key) { return key * 0x9E3779B97F4A7C15ull; }
+
+// The radix partition of a key: the top bits of its hash, so that runs of
+// consecutive keys spread over all partitions.
+inline size_t radix_of(uint64_t key) {
+  return mix(key) >> (64 - bit_width(n_radix - 1));
+}
+
+// The sums of an aggregation: a dense accumulator indexed by key when the
+// key domain is small, or else one hash table per radix partition, with
+// disjoint keys.
+struct GroupSums {
+  Accumulator dense;
+  std::vector<HashAccumulator> partitions;
+
+  bool is_dense() const { return partitions.empty(); }
+
+  // Number of non-empty groups.
+  size_t size() const;
+
+  size_t bytes() const;
+};
+
+// The k groups with the largest sums, or all if fewer, in descending order
+// of sum and then ascending order of key.
+std::vector<Group> top_k(const GroupSums &sums, size_t k);
+
+// A fixed-capacity open-addressing table a thread pre-aggregates into. Once
+// it holds max_local_groups groups, at half load, it spills them into one
+// run per radix partition and starts over empty.
+class LocalAggregator {
+public:
+  LocalAggregator()
+      : spills(n_radix), slots(2 * max_local_groups, {empty, 0}) {}
+
+  void add(uint64_t key, int64_t value) {
+    assert(key != empty);
+    size_t mask = slots.size() - 1;
+    for (size_t i = (mix(key) >> 24) & mask;; i = (i + 1) & mask) {
+      if (slots[i].first == key) {
+        slots[i].second += value;
+        return;
+      }
+      if (slots[i].first == empty) {
+        slots[i] = {key, value};
+        if (++n_groups == max_local_groups) {
+          spill();
+        }
+        return;
+      }
+    }
+  }
+
+  void spill() {
+    for (Group &slot : slots) {
+      if (slot.first != empty) {
+        spills[radix_of(slot.first)].push_back(slot);
+        slot = {empty, 0};
+      }
+    }
+    n_groups = 0;
+  }
+
+  // The spilled groups of each radix partition. A key may recur, within a
+  // run and across threads.
+  std::vector<std::vector<Group>> spills;
+
+private:
+  static constexpr uint64_t empty = UINT64_MAX;
+
+  std::vector<Group> slots;
+  size_t n_groups = 0;
+};
+
+// Sums values by key over rows [0, n_rows), where add_rows(begin, end, add)
+// calls add(key, value) for each row in [begin, end) that passes, with key in
+// [0, domain). A domain of at most 2^max_dense_bits keys is aggregated into
+// dense accumulators, one per task. A larger one is pre-aggregated by each
+// thread and spilled into radix partitions, which are then merged in
+// parallel, each into its own hash table.
+template <typename F>
+GroupSums aggregate(size_t n_rows, uint64_t domain, F add_rows) {
+  GroupSums sums;
+
+  if (domain <= uint64_t(1) << max_dense_bits) {
+    sums.dense = tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, n_rows),
+        Accumulator(domain),
+        [&](const tbb::blocked_range<size_t> &r, Accumulator acc) {
+          TraceSpan span("Morsel", r.begin(), r.end());
+          add_rows(r.begin(), r.end(), [&](uint64_t key, int64_t value) {
+            assert(key < domain);
+            std::pair<bool, int64_t> &slot = acc[key];
+            slot.first = true;
+            slot.second += value;
+          });
+          return acc;
+        },
+        agg_merge);
+    return sums;
+  }
+
+  tbb::enumerable_thread_specific<LocalAggregator> locals;
+
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, n_rows),
+                    [&](const tbb::blocked_range<size_t> &r) {
+                      TraceSpan span("Morsel", r.begin(), r.end());
+                      LocalAggregator &local = locals.local();
+                      add_rows(r.begin(),
+                               r.end(),
+                               [&](uint64_t key, int64_t value) {
+                                 local.add(key, value);
+                               });
+                    });
+
+  tbb::parallel_for_each(locals.begin(),
+                         locals.end(),
+                         [](LocalAggregator &local) { local.spill(); });
+
+  sums.partitions.resize(n_radix);
+  tbb::parallel_for(size_t(0), n_radix, [&](size_t p) {
+    TraceSpan span("MergePartition", p, p + 1);
+    HashAccumulator &table = sums.partitions[p];
+    for (const LocalAggregator &local : locals) {
+      for (const auto &[key, value] : local.spills[p]) {
+        table[key] += value;
+      }
+    }
+  });
+
+  return sums;
+}
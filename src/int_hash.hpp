@@ -0,0 +1,359 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// A vector allocator aligning its storage to a cache line.
+template <typename T> struct CacheAligned {
+  using value_type = T;
+
+  CacheAligned() = default;
+  template <typename U> CacheAligned(const CacheAligned<U> &) {}
+
+  T *allocate(size_t n) {
+    size_t bytes = (n * sizeof(T) + 63) / 64 * 64;
+    void *p = std::aligned_alloc(64, bytes);
+    if (p == nullptr) {
+      throw std::bad_alloc();
+    }
+    return (T *)p;
+  }
+
+  void deallocate(T *p, size_t) { std::free(p); }
+
+  template <typename U> bool operator==(const CacheAligned<U> &) const {
+    return true;
+  }
+  template <typename U> bool operator!=(const CacheAligned<U> &) const {
+    return false;
+  }
+};
+
+// An open-addressing hash table of 32-bit keys, mapping each to a narrow
+// integer V, or a set of them if V is void. Keys sit in buckets of 16, one
+// cache line, compared against a key all at once with SIMD; payloads sit in
+// a separate array, unpadded. A bucket fills from the front and overflows
+// into the next, so a lookup ends at the first bucket that holds the key or
+// has a free slot. There is no erase. Mirrors the parts of the absl tables'
+// interface the queries use, so it stands in for them in hash_set and
+// hash_map. Each instruction set variant of the queries links its own copy,
+// comparing with its own SIMD; the layout is the same in every copy, so a
+// table one copy builds can be probed by another.
+template <typename V> class IntHashTable {
+  static constexpr bool is_set = std::is_void_v<V>;
+
+public:
+  using mapped_type = std::conditional_t<is_set, uint8_t, V>;
+  using value_type =
+      std::conditional_t<is_set, uint32_t, std::pair<uint32_t, mapped_type>>;
+
+  static constexpr size_t bucket_size = 16;
+
+  // Iterates over the entries by value: payloads are narrow, and are
+  // updated through operator[].
+  class iterator {
+  public:
+    struct Arrow {
+      value_type entry;
+      const value_type *operator->() const { return &entry; }
+    };
+
+    value_type operator*() const { return table->entry(slot); }
+    Arrow operator->() const { return {table->entry(slot)}; }
+
+    iterator &operator++() {
+      slot = table->next_slot(slot + 1);
+      return *this;
+    }
+
+    bool operator==(const iterator &other) const {
+      return slot == other.slot;
+    }
+    bool operator!=(const iterator &other) const {
+      return slot != other.slot;
+    }
+
+  private:
+    friend class IntHashTable;
+
+    iterator(const IntHashTable *table, size_t slot)
+        : table(table), slot(slot) {}
+
+    const IntHashTable *table;
+    size_t slot;
+  };
+
+  using const_iterator = iterator;
+
+  IntHashTable() { rehash_buckets(1); }
+
+  size_t size() const { return n_keys + has_empty_key; }
+  bool empty() const { return size() == 0; }
+
+  // Key slots allocated, including free ones.
+  size_t capacity() const { return keys.size(); }
+
+  // Bytes of the key and payload arrays.
+  size_t bytes() const {
+    return keys.capacity() * sizeof(uint32_t) +
+           values.capacity() * sizeof(mapped_type);
+  }
+
+  void reserve(size_t n) {
+    size_t bits = 1;
+    while (max_keys(size_t(1) << bits) < n) {
+      ++bits;
+    }
+    if (bits > bucket_bits) {
+      rehash_buckets(bits);
+    }
+  }
+
+  void clear() { *this = IntHashTable(); }
+
+  iterator begin() const { return {this, next_slot(0)}; }
+  iterator end() const { return {this, capacity() + 1}; }
+
+  iterator find(uint32_t key) const { return {this, find_slot(key)}; }
+
+  bool contains(uint32_t key) const { return find_slot(key) != end_slot(); }
+  size_t count(uint32_t key) const { return contains(key); }
+
+  // Starts loading the bucket a lookup of key would read first.
+  void prefetch(uint32_t key) const {
+    __builtin_prefetch(&keys[bucket_of(key) * bucket_size]);
+    if constexpr (!is_set) {
+      __builtin_prefetch(&values[bucket_of(key) * bucket_size]);
+    }
+  }
+
+  std::pair<iterator, bool> insert(uint32_t key) {
+    auto [slot, inserted] = insert_slot(key);
+    return {{this, slot}, inserted};
+  }
+
+  // A set ignores value.
+  std::pair<iterator, bool> emplace(uint32_t key,
+                                    mapped_type value = mapped_type()) {
+    auto [slot, inserted] = insert_slot(key);
+    if constexpr (!is_set) {
+      if (inserted) {
+        values[slot] = value;
+      }
+    }
+    return {{this, slot}, inserted};
+  }
+
+  mapped_type &operator[](uint32_t key) {
+    return values[insert_slot(key).first];
+  }
+
+  // Looks up keys[0, n), writing the index of each key present to rows and,
+  // for a map, its payload to payloads. Returns the number present. Hashes a
+  // batch of keys in a loop that vectorizes and prefetches their buckets
+  // before comparing any, so that the batch's cache misses overlap.
+  size_t probe(const uint32_t *keys,
+               size_t n,
+               uint32_t *rows,
+               mapped_type *payloads = nullptr) const {
+    constexpr size_t batch = 16;
+    uint32_t buckets[batch];
+    size_t n_found = 0;
+
+    for (size_t base = 0; base < n; base += batch) {
+      size_t m = std::min(batch, n - base);
+      for (size_t k = 0; k < m; ++k) {
+        buckets[k] = bucket_of(keys[base + k]);
+      }
+      for (size_t k = 0; k < m; ++k) {
+        __builtin_prefetch(&this->keys[buckets[k] * bucket_size]);
+      }
+      for (size_t k = 0; k < m; ++k) {
+        size_t slot = find_slot(keys[base + k], buckets[k]);
+        if (slot != end_slot()) {
+          rows[n_found] = uint32_t(base + k);
+          if constexpr (!is_set) {
+            if (payloads != nullptr) {
+              payloads[n_found] = values[slot];
+            }
+          }
+          ++n_found;
+        }
+      }
+    }
+    return n_found;
+  }
+
+private:
+  // Reserved to mark free slots. The entry with this key, if any, lives past
+  // the buckets, in slot capacity().
+  static constexpr uint32_t free_key = UINT32_MAX;
+
+  // Keys at most 7/8 of the slots hold, keeping most probes in one bucket.
+  static size_t max_keys(size_t n_buckets) {
+    return n_buckets * bucket_size / 8 * 7;
+  }
+
+  // Fibonacci hashing: the top bits of the key times 2^32 / phi.
+  uint32_t bucket_of(uint32_t key) const {
+    return (key * 0x9E3779B1u) >> (32 - bucket_bits);
+  }
+
+  // Bitmask of the slots of bucket holding key.
+  static uint32_t match(const uint32_t *bucket, uint32_t key) {
+#if defined(__AVX512F__)
+    return _mm512_cmpeq_epi32_mask(_mm512_load_si512(bucket),
+                                   _mm512_set1_epi32(int(key)));
+#elif defined(__AVX2__)
+    __m256i k = _mm256_set1_epi32(int(key));
+    auto half = [&](const uint32_t *p) {
+      __m256i eq =
+          _mm256_cmpeq_epi32(_mm256_load_si256((const __m256i *)p), k);
+      return uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(eq)));
+    };
+    return half(bucket) | half(bucket + 8) << 8;
+#elif defined(__SSE2__)
+    __m128i k = _mm_set1_epi32(int(key));
+    uint32_t mask = 0;
+    for (size_t i = 0; i < bucket_size; i += 4) {
+      __m128i eq =
+          _mm_cmpeq_epi32(_mm_load_si128((const __m128i *)(bucket + i)), k);
+      mask |= uint32_t(_mm_movemask_ps(_mm_castsi128_ps(eq))) << i;
+    }
+    return mask;
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < bucket_size; ++i) {
+      mask |= uint32_t(bucket[i] == key) << i;
+    }
+    return mask;
+#endif
+  }
+
+  size_t end_slot() const { return capacity() + 1; }
+
+  size_t find_slot(uint32_t key) const {
+    if (key == free_key) {
+      return has_empty_key ? capacity() : end_slot();
+    }
+    return find_slot(key, bucket_of(key));
+  }
+
+  size_t find_slot(uint32_t key, size_t b) const {
+    if (key == free_key) {
+      return find_slot(key);
+    }
+    size_t mask = (size_t(1) << bucket_bits) - 1;
+    for (;; b = (b + 1) & mask) {
+      const uint32_t *bucket = &keys[b * bucket_size];
+      uint32_t m = match(bucket, key);
+      if (m != 0) {
+        return b * bucket_size + __builtin_ctz(m);
+      }
+      if (bucket[bucket_size - 1] == free_key) {
+        return end_slot();
+      }
+    }
+  }
+
+  std::pair<size_t, bool> insert_slot(uint32_t key) {
+    if (key == free_key) {
+      bool inserted = !has_empty_key;
+      has_empty_key = true;
+      return {capacity(), inserted};
+    }
+
+    size_t slot = find_slot(key);
+    if (slot != end_slot()) {
+      return {slot, false};
+    }
+    if (n_keys + 1 > max_keys(size_t(1) << bucket_bits)) {
+      rehash_buckets(bucket_bits + 1);
+    }
+    return {place(key), true};
+  }
+
+  // Stores key, which is absent, in the first free slot of its probe
+  // sequence.
+  size_t place(uint32_t key) {
+    size_t mask = (size_t(1) << bucket_bits) - 1;
+    for (size_t b = bucket_of(key);; b = (b + 1) & mask) {
+      uint32_t m = match(&keys[b * bucket_size], free_key);
+      if (m != 0) {
+        size_t slot = b * bucket_size + __builtin_ctz(m);
+        keys[slot] = key;
+        ++n_keys;
+        return slot;
+      }
+    }
+  }
+
+  // Rebuilds the table with 2^bits buckets.
+  void rehash_buckets(size_t bits) {
+    std::vector<uint32_t, CacheAligned<uint32_t>> old_keys(
+        (size_t(1) << bits) * bucket_size, free_key);
+    std::vector<mapped_type, CacheAligned<mapped_type>> old_values;
+    if constexpr (!is_set) {
+      old_values.resize(old_keys.size() + 1);
+    }
+    std::swap(keys, old_keys);
+    std::swap(values, old_values);
+    bucket_bits = bits;
+    n_keys = 0;
+
+    for (size_t slot = 0; slot < old_keys.size(); ++slot) {
+      if (old_keys[slot] != free_key) {
+        size_t new_slot = place(old_keys[slot]);
+        if constexpr (!is_set) {
+          values[new_slot] = old_values[slot];
+        }
+      }
+    }
+    if constexpr (!is_set) {
+      if (has_empty_key) {
+        values[capacity()] = old_values[old_keys.size()];
+      }
+    }
+  }
+
+  // The first occupied slot at or after slot, or end_slot().
+  size_t next_slot(size_t slot) const {
+    for (; slot < capacity(); ++slot) {
+      if (keys[slot] != free_key) {
+        return slot;
+      }
+    }
+    if (slot == capacity() && has_empty_key) {
+      return slot;
+    }
+    return end_slot();
+  }
+
+  value_type entry(size_t slot) const {
+    uint32_t key = slot == capacity() ? free_key : keys[slot];
+    if constexpr (is_set) {
+      return key;
+    } else {
+      return {key, values[slot]};
+    }
+  }
+
+  std::vector<uint32_t, CacheAligned<uint32_t>> keys;
+  std::vector<mapped_type, CacheAligned<mapped_type>> values;
+  size_t bucket_bits = 0;
+  size_t n_keys = 0;
+  bool has_empty_key = false;
+};
+
+using IntHashSet = IntHashTable<void>;
+template <typename V> using IntHashMap = IntHashTable<V>;
@@ -0,0 +1,70 @@
+#include "isa.hpp"
+
+#include <stdexcept>
+
+#if defined(__x86_64__)
+namespace isa_v2 {
+std::vector<QueryFactory> query_factories();
+}
+
+namespace isa_avx2 {
+std::vector<QueryFactory> query_factories();
+}
+
+namespace isa_avx512 {
+std::vector<QueryFactory> query_factories();
+}
+
+// The features of x86-64-v3 and v4 that compilers use, as cpuid reports
+// them. libgcc also checks that the OS saves the AVX and AVX-512 registers.
+bool supports_avx2() {
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi") &&
+         __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("fma");
+}
+
+bool supports_avx512() {
+  return supports_avx2() && __builtin_cpu_supports("avx512f") &&
+         __builtin_cpu_supports("avx512bw") &&
+         __builtin_cpu_supports("avx512cd") &&
+         __builtin_cpu_supports("avx512dq") &&
+         __builtin_cpu_supports("avx512vl");
+}
+#else
+namespace isa_generic {
+std::vector<QueryFactory> query_factories();
+}
+#endif
+
+bool supports_baseline() { return true; }
+
+const std::vector<Isa> &isas() {
+  static const std::vector<Isa> isas = {
+#if defined(__x86_64__)
+      {"x86-64-v2", supports_baseline, isa_v2::query_factories},
+      {"avx2", supports_avx2, isa_avx2::query_factories},
+      {"avx512", supports_avx512, isa_avx512::query_factories},
+#else
+      {"generic", supports_baseline, isa_generic::query_factories},
+#endif
+  };
+  return isas;
+}
+
+std::string select_isa(const std::string &name) {
+  const Isa *selected = nullptr;
+  for (const Isa &isa : isas()) {
+    if (name == "auto" ? isa.supported() : name == isa.name) {
+      selected = &isa;
+    }
+  }
+
+  if (selected == nullptr) {
+    throw std::runtime_error("unknown instruction set " + name);
+  }
+  if (!selected->supported()) {
+    throw std::runtime_error("this CPU does not support " + name);
+  }
+
+  queries = selected->factories();
+  return selected->name;
+}
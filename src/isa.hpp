@@ -0,0 +1,26 @@
+#pragma once
+
+#include "query.hpp"
+
+#include <string>
+#include <vector>
+
+// An instruction set the query kernels are compiled for.
+struct Isa {
+  const char *name;
+
+  // Whether the CPU running the process supports it.
+  bool (*supported)();
+
+  // The query factories compiled for it, in order.
+  std::vector<QueryFactory> (*factories)();
+};
+
+// The instruction sets the query kernels were compiled for, from least to
+// most capable.
+const std::vector<Isa> &isas();
+
+// Points queries at the factories of the named instruction set, or of the
+// most capable one the CPU supports if name is "auto". Returns the name of
+// the one selected.
+std::string select_isa(const std::string &name);
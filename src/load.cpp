@@ -0,0 +1,513 @@
+#include "column_loader.hpp"
+#include "common.hpp"
+#include "trace.hpp"
+
+#include <sqlite3.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <istream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+template <typename T> struct Column {
+  Column(size_t argIndex, std::vector<T> &argValues)
+      : index(argIndex), values(argValues) {}
+  size_t index;
+  std::vector<T> &values;
+};
+
+void read_column(sqlite3_stmt *stmt, const Column<uint8_t> &column) {
+  int value = sqlite3_column_int(stmt, (int)column.index);
+  column.values.push_back(value);
+}
+
+void read_column(sqlite3_stmt *stmt, const Column<uint16_t> &column) {
+  int value = sqlite3_column_int(stmt, (int)column.index);
+  column.values.push_back(value);
+}
+
+void read_column(sqlite3_stmt *stmt, const Column<uint32_t> &column) {
+  int value = sqlite3_column_int(stmt, (int)column.index);
+  column.values.push_back(value);
+}
+
+void read_column(sqlite3_stmt *stmt, const Column<std::string> &column) {
+  std::string value = (char *)sqlite3_column_text(stmt, (int)column.index);
+  column.values.push_back(value);
+}
+
+sqlite3 *open_db(const char *path) {
+  sqlite3 *db;
+  int rc = sqlite3_open(path, &db);
+  if (rc != SQLITE_OK) {
+    throw std::runtime_error(sqlite3_errmsg(db));
+  }
+  return db;
+}
+
+sqlite3_stmt *prepare_stmt(sqlite3 *db, const std::string &sql) {
+  sqlite3_stmt *stmt;
+  int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+  if (rc != SQLITE_OK) {
+    throw std::runtime_error(sqlite3_errmsg(db));
+  }
+  return stmt;
+}
+
+template <typename... T>
+void read_table(const char *path,
+                const char *table,
+                const std::string &where,
+                Column<T>... columns) {
+  int rc;
+
+  sqlite3 *db = open_db(path);
+
+  std::string sql = "SELECT * FROM " + std::string(table) + where;
+
+  sqlite3_stmt *stmt = prepare_stmt(db, sql);
+
+  while (true) {
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+      (read_column(stmt, columns), ...);
+    } else if (rc == SQLITE_DONE) {
+      break;
+    } else {
+      throw std::runtime_error(sqlite3_errmsg(db));
+    }
+  }
+
+  sqlite3_finalize(stmt);
+  sqlite3_close(db);
+}
+
+// The permutation that reorders the rows of a table stably into partition
+// order by key % n_pt, where keys is its key column, and the partitions of
+// the reordered table in pt.
+std::vector<uint32_t> partition_order(const std::vector<uint32_t> &keys,
+                                      Partitions &pt) {
+  pt.offsets.assign(n_pt + 1, 0);
+  for (uint32_t key : keys) {
+    ++pt.offsets[key % n_pt + 1];
+  }
+  for (size_t i = 0; i < n_pt; ++i) {
+    pt.offsets[i + 1] += pt.offsets[i];
+  }
+
+  std::vector<uint32_t> order(keys.size());
+  std::vector<uint32_t> next(pt.offsets.begin(), pt.offsets.end() - 1);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    order[next[keys[i] % n_pt]++] = uint32_t(i);
+  }
+  return order;
+}
+
+template <typename T>
+void permute(std::vector<T> &column, const std::vector<uint32_t> &order) {
+  std::vector<T> result(column.size());
+  for (size_t j = 0; j < order.size(); ++j) {
+    result[j] = column[order[j]];
+  }
+  column = std::move(result);
+}
+
+// Reorders the rows of a table stably into partition order by key % n_pt,
+// where keys is its key column.
+template <typename... T>
+Partitions partition_rows(std::vector<uint32_t> &keys,
+                          std::vector<T> &...columns) {
+  Partitions pt;
+  std::vector<uint32_t> order = partition_order(keys, pt);
+  permute(keys, order);
+  (permute(columns, order), ...);
+  return pt;
+}
+
+// Reads the dictionary of an encoded column from its <column>_codes table.
+Dictionary read_dictionary(const char *path, const std::string &column) {
+  std::vector<uint32_t> codes;
+  std::vector<std::string> values;
+  std::string table = column + "_codes";
+  read_table(path,
+             table.c_str(),
+             " ORDER BY " + column + "_code",
+             Column(0, codes),
+             Column(1, values));
+  return Dictionary(column, codes, std::move(values));
+}
+
+void load_dictionaries(const char *path, Database &db) {
+  db.dicts.mfgr = read_dictionary(path, "mfgr");
+  db.dicts.category = read_dictionary(path, "category");
+  db.dicts.brand1 = read_dictionary(path, "brand1");
+  db.dicts.city = read_dictionary(path, "city");
+  db.dicts.nation = read_dictionary(path, "nation");
+  db.dicts.region = read_dictionary(path, "region");
+  db.dicts.yearmonth = read_dictionary(path, "yearmonth");
+}
+
+void partition_dimensions(Database &db) {
+  db.p_pt =
+      partition_rows(db.p.partkey, db.p.mfgr, db.p.category, db.p.brand1);
+  db.c_pt =
+      partition_rows(db.c.custkey, db.c.city, db.c.nation, db.c.region);
+}
+
+void load_dimensions(const char *path, Database &db) {
+  read_table(path,
+             "part_encoded",
+             "",
+             Column(0, db.p.partkey),
+             Column(2, db.p.mfgr),
+             Column(3, db.p.category),
+             Column(4, db.p.brand1));
+
+  read_table(path,
+             "supplier_encoded",
+             "",
+             Column(0, db.s.suppkey),
+             Column(3, db.s.city),
+             Column(4, db.s.nation),
+             Column(5, db.s.region));
+
+  read_table(path,
+             "customer_encoded",
+             "",
+             Column(0, db.c.custkey),
+             Column(3, db.c.city),
+             Column(4, db.c.nation),
+             Column(5, db.c.region));
+
+  read_table(path,
+             "date_encoded",
+             "",
+             Column(0, db.d.datekey),
+             Column(4, db.d.year),
+             Column(5, db.d.yearmonthnum),
+             Column(6, db.d.yearmonth),
+             Column(11, db.d.weeknuminyear));
+
+  load_dictionaries(path, db);
+  partition_dimensions(db);
+}
+
+LineorderReader::LineorderReader(const char *path,
+                                 int64_t rowid_begin,
+                                 int64_t rowid_end)
+    : db(open_db(path)) {
+  std::string sql = "SELECT * FROM lineorder";
+  if (rowid_begin != 0 || rowid_end != INT64_MAX) {
+    sql += " WHERE rowid >= " + std::to_string(rowid_begin) +
+           " AND rowid < " + std::to_string(rowid_end);
+  }
+
+  stmt = prepare_stmt(db, sql);
+}
+
+LineorderReader::~LineorderReader() {
+  sqlite3_finalize(stmt);
+  sqlite3_close(db);
+}
+
+bool LineorderReader::read(Lineorder &lo, size_t n_rows) {
+  lo.clear();
+  if (n_rows != SIZE_MAX) {
+    lo.reserve(n_rows);
+  }
+
+  for (size_t i = 0; i < n_rows && !done; ++i) {
+    int rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+      read_column(stmt, Column(2, lo.custkey));
+      read_column(stmt, Column(3, lo.partkey));
+      read_column(stmt, Column(4, lo.suppkey));
+      read_column(stmt, Column(5, lo.orderdate));
+      read_column(stmt, Column(8, lo.quantity));
+      read_column(stmt, Column(9, lo.extendedprice));
+      read_column(stmt, Column(11, lo.discount));
+      read_column(stmt, Column(12, lo.revenue));
+      read_column(stmt, Column(13, lo.supplycost));
+    } else if (rc == SQLITE_DONE) {
+      // Stepping again would restart the scan.
+      done = true;
+    } else {
+      throw std::runtime_error(sqlite3_errmsg(db));
+    }
+  }
+
+  return !lo.orderdate.empty();
+}
+
+void load_lineorder(const char *path,
+                    Lineorder &lo,
+                    int64_t rowid_begin,
+                    int64_t rowid_end) {
+  LineorderReader(path, rowid_begin, rowid_end).read(lo, SIZE_MAX);
+}
+
+bool read_lineorder_tbl(std::istream &in, Lineorder &lo, size_t n_rows) {
+  lo.clear();
+
+  std::string line;
+  std::vector<uint32_t> fields;
+  while (lo.orderdate.size() < n_rows && std::getline(in, line)) {
+    if (line.empty()) {
+      continue;
+    }
+
+    fields.clear();
+    size_t begin = 0;
+    for (size_t end; (end = line.find('|', begin)) != std::string::npos;
+         begin = end + 1) {
+      // Text fields parse as zero; only the integer ones are kept.
+      fields.push_back(std::strtoul(line.c_str() + begin, nullptr, 10));
+    }
+
+    if (fields.size() < 14) {
+      throw std::runtime_error("malformed lineorder row: " + line);
+    }
+
+    lo.custkey.push_back(fields[2]);
+    lo.partkey.push_back(fields[3]);
+    lo.suppkey.push_back(fields[4]);
+    lo.orderdate.push_back(fields[5]);
+    lo.quantity.push_back(fields[8]);
+    lo.extendedprice.push_back(fields[9]);
+    lo.discount.push_back(fields[11]);
+    lo.revenue.push_back(fields[12]);
+    lo.supplycost.push_back(fields[13]);
+  }
+
+  return !lo.orderdate.empty();
+}
+
+std::pair<int64_t, int64_t> lineorder_rowids(const char *path) {
+  sqlite3 *db = open_db(path);
+  sqlite3_stmt *stmt =
+      prepare_stmt(db, "SELECT min(rowid), max(rowid) + 1 FROM lineorder");
+
+  if (sqlite3_step(stmt) != SQLITE_ROW) {
+    throw std::runtime_error(sqlite3_errmsg(db));
+  }
+
+  std::pair<int64_t, int64_t> rowids(sqlite3_column_int64(stmt, 0),
+                                     sqlite3_column_int64(stmt, 1));
+
+  sqlite3_finalize(stmt);
+  sqlite3_close(db);
+
+  return rowids;
+}
+
+// A column of a Database and where the database file stores it.
+struct ColumnSource {
+  ColumnSet column;
+  const char *table;
+  const char *name;
+  void (*read)(sqlite3_stmt *stmt, int index, void *values);
+  void (*permute)(void *values, const std::vector<uint32_t> &order);
+  void *values;
+};
+
+template <typename T>
+void read_value(sqlite3_stmt *stmt, int index, void *values) {
+  ((std::vector<T> *)values)->push_back(sqlite3_column_int(stmt, index));
+}
+
+template <typename T>
+void permute_values(void *values, const std::vector<uint32_t> &order) {
+  permute(*(std::vector<T> *)values, order);
+}
+
+template <typename T>
+ColumnSource source(ColumnSet column,
+                    const char *table,
+                    const char *name,
+                    std::vector<T> &values) {
+  return {column, table, name, read_value<T>, permute_values<T>, &values};
+}
+
+std::vector<ColumnSource> column_sources(Database &db) {
+  const char *p = "part_encoded";
+  const char *s = "supplier_encoded";
+  const char *c = "customer_encoded";
+  const char *d = "date_encoded";
+  const char *lo = "lineorder";
+  return {source(col::p_partkey, p, "partkey", db.p.partkey),
+          source(col::p_mfgr, p, "p_mfgr", db.p.mfgr),
+          source(col::p_category, p, "p_category", db.p.category),
+          source(col::p_brand1, p, "p_brand1", db.p.brand1),
+          source(col::s_suppkey, s, "s_suppkey", db.s.suppkey),
+          source(col::s_city, s, "s_city", db.s.city),
+          source(col::s_nation, s, "s_nation", db.s.nation),
+          source(col::s_region, s, "s_region", db.s.region),
+          source(col::c_custkey, c, "c_custkey", db.c.custkey),
+          source(col::c_city, c, "c_city", db.c.city),
+          source(col::c_nation, c, "c_nation", db.c.nation),
+          source(col::c_region, c, "c_region", db.c.region),
+          source(col::d_datekey, d, "d_datekey", db.d.datekey),
+          source(col::d_year, d, "d_year", db.d.year),
+          source(col::d_yearmonthnum, d, "d_yearmonthnum", db.d.yearmonthnum),
+          source(col::d_yearmonth, d, "d_yearmonth", db.d.yearmonth),
+          source(col::d_weeknuminyear,
+                 d,
+                 "d_weeknuminyear",
+                 db.d.weeknuminyear),
+          source(col::lo_custkey, lo, "lo_custkey", db.lo.custkey),
+          source(col::lo_partkey, lo, "lo_partkey", db.lo.partkey),
+          source(col::lo_suppkey, lo, "lo_suppkey", db.lo.suppkey),
+          source(col::lo_orderdate, lo, "lo_orderdate", db.lo.orderdate),
+          source(col::lo_quantity, lo, "lo_quantity", db.lo.quantity),
+          source(col::lo_extendedprice,
+                 lo,
+                 "lo_extendedprice",
+                 db.lo.extendedprice),
+          source(col::lo_discount, lo, "lo_discount", db.lo.discount),
+          source(col::lo_revenue, lo, "lo_revenue", db.lo.revenue),
+          source(col::lo_supplycost, lo, "lo_supplycost", db.lo.supplycost)};
+}
+
+// Adds the key of each partitioned table set has a column of.
+ColumnSet with_keys(ColumnSet set) {
+  if (set & col::part) {
+    set |= col::p_partkey;
+  }
+  if (set & col::customer) {
+    set |= col::c_custkey;
+  }
+  return set;
+}
+
+ColumnLoader::ColumnLoader(const char *path, Database &db)
+    : path(path), db(db) {
+  load_dictionaries(path, db);
+  worker = std::thread([this] { work(); });
+}
+
+ColumnLoader::~ColumnLoader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  changed.notify_all();
+  worker.join();
+}
+
+void ColumnLoader::prefetch(ColumnSet set) {
+  std::lock_guard<std::mutex> lock(mutex);
+  set = with_keys(set) & ~queued;
+  if (set != 0) {
+    queue.push_back(set);
+    queued |= set;
+    changed.notify_all();
+  }
+}
+
+void ColumnLoader::load(ColumnSet set) {
+  prefetch(set);
+  set = with_keys(set);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  changed.wait(lock, [&] { return error || (loaded_set & set) == set; });
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+ColumnSet ColumnLoader::loaded() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return loaded_set;
+}
+
+void ColumnLoader::work() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    changed.wait(lock, [&] { return stopping || !queue.empty(); });
+    if (stopping) {
+      return;
+    }
+
+    ColumnSet set = queue.front();
+    queue.pop_front();
+
+    lock.unlock();
+    try {
+      TraceSpan span("LoadColumns");
+      read(set);
+    } catch (...) {
+      lock.lock();
+      error = std::current_exception();
+      changed.notify_all();
+      return;
+    }
+    lock.lock();
+
+    loaded_set |= set;
+    changed.notify_all();
+  }
+}
+
+void ColumnLoader::read(ColumnSet set) {
+  std::vector<ColumnSource> sources = column_sources(db);
+
+  for (const char *table : {"part_encoded",
+                            "supplier_encoded",
+                            "customer_encoded",
+                            "date_encoded",
+                            "lineorder"}) {
+    std::vector<ColumnSource> selected;
+    std::string names;
+    for (const ColumnSource &source : sources) {
+      if ((set & source.column) && std::strcmp(source.table, table) == 0) {
+        names += (names.empty() ? "" : ", ") + std::string(source.name);
+        selected.push_back(source);
+      }
+    }
+    if (selected.empty()) {
+      continue;
+    }
+
+    sqlite3 *handle = open_db(path.c_str());
+    // In rowid order, so that the columns of a table read by different
+    // statements line up.
+    sqlite3_stmt *stmt = prepare_stmt(
+        handle,
+        "SELECT " + names + " FROM " + table + " ORDER BY rowid");
+
+    while (true) {
+      int rc = sqlite3_step(stmt);
+      if (rc == SQLITE_ROW) {
+        for (size_t i = 0; i < selected.size(); ++i) {
+          selected[i].read(stmt, int(i), selected[i].values);
+        }
+      } else if (rc == SQLITE_DONE) {
+        break;
+      } else {
+        throw std::runtime_error(sqlite3_errmsg(handle));
+      }
+    }
+
+    sqlite3_finalize(stmt);
+    sqlite3_close(handle);
+  }
+
+  // The orders come from the keys as read, before they are permuted along
+  // with the other columns of the set.
+  if (set & col::p_partkey) {
+    p_order = partition_order(db.p.partkey, db.p_pt);
+  }
+  if (set & col::c_custkey) {
+    c_order = partition_order(db.c.custkey, db.c_pt);
+  }
+  for (const ColumnSource &source : sources) {
+    if (set & source.column & col::part) {
+      source.permute(source.values, p_order);
+    } else if (set & source.column & col::customer) {
+      source.permute(source.values, c_order);
+    }
+  }
+}
@@ -1,152 +1,372 @@
-#include "common.hpp"
+#include "column_loader.hpp"
+#include "isa.hpp"
+#include "query.hpp"
+#include "trace.hpp"
 
-#include <sqlite3.h>
-
-#include <chrono>
+#include <algorithm>
 #include <iostream>
+#include <stdexcept>
 #include <string>
-#include <vector>
-
-template <typename T> struct Column {
-  Column(size_t argIndex, std::vector<T> &argValues)
-      : index(argIndex), values(argValues) {}
-  size_t index;
-  std::vector<T> &values;
-};
-
-void read_column(sqlite3_stmt *stmt, Column<uint8_t> &column) {
-  int value = sqlite3_column_int(stmt, (int)column.index);
-  column.values.push_back(value);
-}
 
-void read_column(sqlite3_stmt *stmt, Column<uint16_t> &column) {
-  int value = sqlite3_column_int(stmt, (int)column.index);
-  column.values.push_back(value);
+// Benchmarks a query over all of db.lo, logging the bytes of its structures
+// and the peak RSS of each phase, and tracing each phase when tracing is on.
+// With prefetch, also times the prefetching probe and keeps its result.
+void run(Query &q, const Database &db, bool prefetch) {
+  double latency;
+  Accumulator acc;
+
+  reset_peak_rss();
+
+  {
+    TraceSpan span(intern(q.name + " Build"));
+    q.build();
+  }
+
+  log(q.name, "BuildPeakRSS", peak_rss());
+  q.log_bytes();
+
+  reset_peak_rss();
+
+  {
+    TraceSpan span(intern(q.name + " Probe"));
+    latency = time([&] { acc = q.probe(db.lo); });
+  }
+
+  log(q.name, "Probe", latency);
+  log(q.name, "ProbePeakRSS", peak_rss());
+
+  // Counted after the timed probe, which reads the same rows with or without
+  // prefetching.
+  size_t probe_bytes = q.probe_bytes(db.lo);
+  log_bandwidth(q.name, "Probe", probe_bytes, latency);
+
+  if (prefetch) {
+    q.prefetch = true;
+
+    double prefetch_latency;
+    {
+      TraceSpan span(intern(q.name + " PrefetchProbe"));
+      prefetch_latency = time([&] { acc = q.probe(db.lo); });
+    }
+
+    log(q.name, "PrefetchProbe", prefetch_latency);
+    log(q.name, "PrefetchSpeedup", latency / prefetch_latency);
+    log_bandwidth(q.name, "PrefetchProbe", probe_bytes, prefetch_latency);
+  }
+
+  {
+    TraceSpan span(intern(q.name + " Finalize"));
+    latency = time([&] { q.finalize(acc); });
+  }
+
+  log(q.name, "Finalize", latency);
+
+  q.print();
+
+  reset_peak_rss();
+
+  {
+    TraceSpan span(intern(q.name + " Agg"));
+    acc = q.agg(db.lo);
+  }
+
+  log(q.name, "AggPeakRSS", peak_rss());
+
+  q.finalize(acc);
+
+  q.print();
 }
 
-void read_column(sqlite3_stmt *stmt, Column<uint32_t> &column) {
-  int value = sqlite3_column_int(stmt, (int)column.index);
-  column.values.push_back(value);
+// Benchmarks every query over db, prefetching those selected by the prefetch
+// list.
+void run_queries(const Database &db, const std::string &prefetch) {
+  for (QueryFactory make : queries) {
+    std::unique_ptr<Query> q = make(db);
+    run(*q, db, selected(prefetch, q->name));
+  }
 }
 
-void read_column(sqlite3_stmt *stmt, Column<std::string> &column) {
-  std::string value = (char *)sqlite3_column_text(stmt, (int)column.index);
-  column.values.push_back(value);
+// Measures the peak read bandwidth that the probe and agg phases are compared
+// with, on a buffer of mb MiB, unless mb is 0.
+void measure_peak_bandwidth(size_t mb) {
+  if (mb == 0) {
+    return;
+  }
+
+  {
+    TraceSpan span("Bandwidth");
+    peak_read_bandwidth = measure_read_bandwidth(mb << 20);
+  }
+
+  log("Bandwidth", "PeakGBps", peak_read_bandwidth / 1e9);
+  reset_peak_rss();
 }
 
-template <typename... T>
-void read_table(const char *path, const char *table, Column<T>... columns) {
-  int rc;
+// Benchmarks the queries of the query list, loading only the columns they
+// read: those of the first before it runs, and those of each later one in the
+// background meanwhile.
+void run_all(const char *path,
+             const std::string &query_list,
+             const std::string &prefetch,
+             size_t bandwidth_mb) {
+  double latency;
+
+  measure_peak_bandwidth(bandwidth_mb);
+
+  Database db;
+  ColumnLoader loader(path, db);
+
+  std::vector<QueryFactory> factories;
+  std::vector<ColumnSet> columns;
+  for (QueryFactory make : queries) {
+    std::unique_ptr<Query> q = make(db);
+    if (selected(query_list, q->name)) {
+      factories.push_back(make);
+      columns.push_back(q->columns());
+    }
+  }
+  if (factories.empty()) {
+    throw std::runtime_error("no queries match " + query_list);
+  }
 
-  sqlite3 *db;
-  rc = sqlite3_open(path, &db);
-  if (rc != SQLITE_OK) {
-    throw std::runtime_error(sqlite3_errmsg(db));
+  {
+    TraceSpan span("Load");
+    latency = time([&] { loader.load(columns.front()); });
   }
 
-  std::string sql = "SELECT * FROM " + std::string(table);
+  log("Load", "Latency", latency);
+  log("Load", "Columns", __builtin_popcount(loader.loaded()));
+  log("Load", "PeakRSS", peak_rss());
 
-  sqlite3_stmt *stmt;
-  rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
-  if (rc != SQLITE_OK) {
-    throw std::runtime_error(sqlite3_errmsg(db));
+  for (ColumnSet set : columns) {
+    loader.prefetch(set);
   }
 
-  while (true) {
-    rc = sqlite3_step(stmt);
-    if (rc == SQLITE_ROW) {
-      (read_column(stmt, columns), ...);
-    } else if (rc == SQLITE_DONE) {
-      break;
-    } else {
-      throw std::runtime_error(sqlite3_errmsg(db));
-    }
+  for (size_t i = 0; i < factories.size(); ++i) {
+    latency = time([&] { loader.load(columns[i]); });
+    std::unique_ptr<Query> q = factories[i](db);
+    log(q->name, "LoadWait", latency);
+    run(*q, db, selected(prefetch, q->name));
   }
+
+  log("Load", "TotalColumns", __builtin_popcount(loader.loaded()));
+  log_memory(db);
 }
 
-int main(int argc, char **argv) {
-  if (argc != 2) {
-    std::cerr << "USAGE: " << std::endl;
-    std::cerr << argv[0] << " DB_PATH" << std::endl;
-    return 1;
+// Logs how unevenly a lineorder foreign key spreads over the n_pt hash table
+// partitions: the rows of the largest partition over those of the mean one.
+void log_partition_skew(const std::string &key,
+                        const std::vector<uint32_t> &column) {
+  std::vector<size_t> rows(n_pt);
+  for (uint32_t k : column) {
+    ++rows[k % n_pt];
   }
+  size_t max_rows = *std::max_element(rows.begin(), rows.end());
+  log("Generate",
+      key + "PartitionSkew",
+      double(max_rows) * n_pt / column.size());
+}
+
+// Generates the database at scale factor sf, with Zipf-distributed foreign
+// keys if zipf > 0, and benchmarks every query.
+void run_generated(double sf,
+                   double zipf,
+                   const std::string &prefetch,
+                   size_t bandwidth_mb) {
+  double latency;
 
-  char *db_path = argv[1];
+  measure_peak_bandwidth(bandwidth_mb);
 
   Database db;
 
-  read_table(db_path,
-             "part_encoded",
-             Column(0, db.p.partkey),
-             Column(2, db.p.mfgr),
-             Column(3, db.p.category),
-             Column(4, db.p.brand1));
-
-  read_table(db_path,
-             "supplier_encoded",
-             Column(0, db.s.suppkey),
-             Column(3, db.s.city),
-             Column(4, db.s.nation),
-             Column(5, db.s.region));
-
-  read_table(db_path,
-             "customer_encoded",
-             Column(0, db.c.custkey),
-             Column(3, db.c.city),
-             Column(4, db.c.nation),
-             Column(5, db.c.region));
-
-  read_table(db_path,
-             "date_encoded",
-             Column(0, db.d.datekey),
-             Column(4, db.d.year),
-             Column(5, db.d.yearmonthnum),
-             Column(6, db.d.yearmonth),
-             Column(11, db.d.weeknuminyear));
-
-  read_table(db_path,
-             "lineorder",
-             Column(2, db.lo.custkey),
-             Column(3, db.lo.partkey),
-             Column(4, db.lo.suppkey),
-             Column(5, db.lo.orderdate),
-             Column(8, db.lo.quantity),
-             Column(9, db.lo.extendedprice),
-             Column(11, db.lo.discount),
-             Column(12, db.lo.revenue),
-             Column(13, db.lo.supplycost));
-
-  db.p_pt = std::vector<Part>(n_pt);
-  for (size_t i = 0; i < db.p.partkey.size(); ++i) {
-    Part &pt = db.p_pt[db.p.partkey[i] % n_pt];
-    pt.partkey.push_back(db.p.partkey[i]);
-    pt.mfgr.push_back(db.p.mfgr[i]);
-    pt.category.push_back(db.p.category[i]);
-    pt.brand1.push_back(db.p.brand1[i]);
-  }
-
-  db.c_pt = std::vector<Customer>(n_pt);
-  for (size_t i = 0; i < db.c.custkey.size(); ++i) {
-    Customer &pt = db.c_pt[db.c.custkey[i] % n_pt];
-    pt.custkey.push_back(db.c.custkey[i]);
-    pt.city.push_back(db.c.city[i]);
-    pt.nation.push_back(db.c.nation[i]);
-    pt.region.push_back(db.c.region[i]);
-  }
-
-  q1p1(db);
-  q1p2(db);
-  q1p3(db);
-  q2p1(db);
-  q2p2(db);
-  q2p3(db);
-  q3p1(db);
-  q3p2(db);
-  q3p3(db);
-  q3p4(db);
-  q4p1(db);
-  q4p2(db);
-  q4p3(db);
+  {
+    TraceSpan span("Generate");
+    latency = time([&] { generate(db, sf, zipf, 1); });
+  }
+
+  log("Generate", "Latency", latency);
+  log("Generate", "Rows", db.lo.orderdate.size());
+  log("Generate", "PeakRSS", peak_rss());
+  log_partition_skew("Custkey", db.lo.custkey);
+  log_partition_skew("Partkey", db.lo.partkey);
+  log_partition_skew("Suppkey", db.lo.suppkey);
+  log_memory(db);
+
+  run_queries(db, prefetch);
+}
+
+int usage(const char *argv0) {
+  std::cerr << "USAGE: " << std::endl;
+  std::cerr << argv0 << " [OPTION] DB_PATH" << std::endl;
+  std::cerr << argv0 << " --generate SF [--zipf S] [--prefetch QUERIES]"
+            << std::endl;
+  std::cerr << std::endl;
+  std::cerr << "OPTIONS: " << std::endl;
+  std::cerr << "  --shards N          probe in N worker processes" << std::endl;
+  std::cerr << "  --stream-mb MB      stream lineorder in MB MiB of memory"
+            << std::endl;
+  std::cerr << "  --append TBL_PATH   append lineorder rows from TBL_PATH"
+            << std::endl;
+  std::cerr << "  --batch-rows N      rows per append batch (default 100000)"
+            << std::endl;
+  std::cerr << "  --cubes             answer queries from pre-aggregated cubes"
+            << std::endl;
+  std::cerr << "  --denormalize       also scan pre-joined dimension columns"
+            << std::endl;
+  std::cerr << "  --bitmaps           also probe only rows bitmaps select"
+            << std::endl;
+  std::cerr << "  --prefetch QUERIES  also probe QUERIES (e.g. Q2.1,Q4.3 or"
+            << std::endl;
+  std::cerr << "                      all) with grouped prefetching lookups"
+            << std::endl;
+  std::cerr << "  --sample RATE       estimate results from a RATE sample"
+            << std::endl;
+  std::cerr << "  --top K             print the top K groups by foreign key"
+            << std::endl;
+  std::cerr << "  --serve SOCKET_PATH serve queries on a Unix-domain socket"
+            << std::endl;
+  std::cerr << "  --generate SF       generate data at scale factor SF"
+            << std::endl;
+  std::cerr << "  --zipf S            draw generated foreign keys from a Zipf"
+            << std::endl;
+  std::cerr << "                      distribution of exponent S" << std::endl;
+  std::cerr << "  --sweep THREADS     time each phase at each thread count of"
+            << std::endl;
+  std::cerr << "                      THREADS (e.g. 1,2,4 or all)" << std::endl;
+  std::cerr << "  --queries QUERIES   queries to run or sweep (default all)"
+            << std::endl;
+  std::cerr << "  --pin PLACEMENT     pin swept threads: none (default), spread"
+            << std::endl;
+  std::cerr << "                      over cores first, or compact onto SMT"
+            << std::endl;
+  std::cerr << "                      siblings" << std::endl;
+  std::cerr << "  --trace JSON_PATH   write a trace of phases and morsels"
+            << std::endl;
+  std::cerr << "  --bandwidth-mb MB   measure peak read bandwidth over MB MiB"
+            << std::endl;
+  std::cerr << "                      (default 512, 0 to skip)" << std::endl;
+  std::cerr << "  --isa ISA           run the query kernels compiled for ISA:"
+            << std::endl;
+  std::cerr << "                      x86-64-v2, avx2, avx512 or auto"
+            << std::endl;
+  std::cerr << "                      (default, the best the CPU supports)"
+            << std::endl;
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  char *db_path = nullptr;
+  size_t n_shards = 0;
+  size_t stream_mb = 0;
+  char *append_path = nullptr;
+  size_t batch_rows = 100000;
+  bool cubes = false;
+  bool denormalized = false;
+  bool bitmaps = false;
+  std::string prefetch;
+  double sample_rate = 0;
+  size_t top_k = 0;
+  char *trace_path = nullptr;
+  char *socket_path = nullptr;
+  double generate_sf = 0;
+  double zipf = 0;
+  std::string sweep_threads;
+  std::string query_list = "all";
+  std::string pin = "none";
+  std::string isa = "auto";
+  size_t bandwidth_mb = 512;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--shards" && i + 1 < argc) {
+      n_shards = std::stoul(argv[++i]);
+    } else if (arg == "--stream-mb" && i + 1 < argc) {
+      stream_mb = std::stoul(argv[++i]);
+    } else if (arg == "--append" && i + 1 < argc) {
+      append_path = argv[++i];
+    } else if (arg == "--batch-rows" && i + 1 < argc) {
+      batch_rows = std::stoul(argv[++i]);
+    } else if (arg == "--cubes") {
+      cubes = true;
+    } else if (arg == "--denormalize") {
+      denormalized = true;
+    } else if (arg == "--prefetch" && i + 1 < argc) {
+      prefetch = argv[++i];
+    } else if (arg == "--bitmaps") {
+      bitmaps = true;
+    } else if (arg == "--sample" && i + 1 < argc) {
+      sample_rate = std::stod(argv[++i]);
+    } else if (arg == "--top" && i + 1 < argc) {
+      top_k = std::stoul(argv[++i]);
+    } else if (arg == "--generate" && i + 1 < argc) {
+      generate_sf = std::stod(argv[++i]);
+    } else if (arg == "--zipf" && i + 1 < argc) {
+      zipf = std::stod(argv[++i]);
+    } else if (arg == "--sweep" && i + 1 < argc) {
+      sweep_threads = argv[++i];
+    } else if (arg == "--queries" && i + 1 < argc) {
+      query_list = argv[++i];
+    } else if (arg == "--pin" && i + 1 < argc) {
+      pin = argv[++i];
+    } else if (arg == "--trace" && i + 1 < argc) {
+      trace_path = argv[++i];
+    } else if (arg == "--bandwidth-mb" && i + 1 < argc) {
+      bandwidth_mb = std::stoul(argv[++i]);
+    } else if (arg == "--isa" && i + 1 < argc) {
+      isa = argv[++i];
+    } else if (arg == "--serve" && i + 1 < argc) {
+      socket_path = argv[++i];
+    } else if (db_path == nullptr && arg.rfind("--", 0) != 0) {
+      db_path = argv[i];
+    } else {
+      return usage(argv[0]);
+    }
+  }
+
+  if (db_path == nullptr && generate_sf <= 0) {
+    return usage(argv[0]);
+  }
+
+  // Errors, such as a query whose group-by domain the loaded dictionaries
+  // do not fit, end the run with a message rather than in std::terminate.
+  try {
+    tracing = trace_path != nullptr;
+
+    log("Isa", "Selected", select_isa(isa));
+
+    if (generate_sf > 0) {
+      run_generated(generate_sf, zipf, prefetch, bandwidth_mb);
+    } else if (n_shards > 0) {
+      run_sharded(db_path, n_shards);
+    } else if (stream_mb > 0) {
+      run_streaming(db_path, stream_mb);
+    } else if (append_path != nullptr) {
+      run_appends(db_path, append_path, batch_rows);
+    } else if (cubes) {
+      run_cubes(db_path);
+    } else if (denormalized) {
+      run_denormalized(db_path);
+    } else if (bitmaps) {
+      run_bitmaps(db_path);
+    } else if (sample_rate > 0) {
+      run_sampled(db_path, sample_rate);
+    } else if (top_k > 0) {
+      run_top(db_path, top_k);
+    } else if (!sweep_threads.empty()) {
+      run_sweep(db_path, sweep_threads, query_list, pin);
+    } else if (socket_path != nullptr) {
+      run_server(db_path, socket_path);
+    } else {
+      run_all(db_path, query_list, prefetch, bandwidth_mb);
+    }
+
+    if (trace_path != nullptr) {
+      write_trace(trace_path);
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return 1;
+  }
 
   return 0;
 }
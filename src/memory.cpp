@@ -0,0 +1,100 @@
+#include "common.hpp"
+
+#include <sys/resource.h>
+
+#include <fstream>
+#include <string>
+
+void reset_peak_rss() {
+  // Writing 5 to clear_refs resets the peak (VmHWM) to the current RSS.
+  std::ofstream("/proc/self/clear_refs") << "5";
+}
+
+size_t peak_rss() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.rfind("VmHWM:", 0) == 0) {
+      return std::stoul(line.substr(6)) * 1024;
+    }
+  }
+
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return size_t(usage.ru_maxrss) * 1024;
+}
+
+// Logs the bytes of each column of a table, and their total.
+template <typename... T>
+size_t log_table(const std::string &table,
+                 std::initializer_list<const char *> names,
+                 const std::vector<T> &...columns) {
+  const char *const *name = names.begin();
+  size_t total = 0;
+  auto column = [&](const auto &values) {
+    size_t bytes = allocated_bytes(values);
+    log("Memory", table + "." + *name++, bytes);
+    total += bytes;
+  };
+  (column(columns), ...);
+  log("Memory", table, total);
+  return total;
+}
+
+void log_memory(const Database &db) {
+  size_t total = 0;
+
+  total += log_table("p",
+                     {"partkey", "mfgr", "category", "brand1"},
+                     db.p.partkey,
+                     db.p.mfgr,
+                     db.p.category,
+                     db.p.brand1);
+  total += log_table("s",
+                     {"suppkey", "city", "nation", "region"},
+                     db.s.suppkey,
+                     db.s.city,
+                     db.s.nation,
+                     db.s.region);
+  total += log_table("c",
+                     {"custkey", "city", "nation", "region"},
+                     db.c.custkey,
+                     db.c.city,
+                     db.c.nation,
+                     db.c.region);
+  total += log_table(
+      "d",
+      {"datekey", "year", "yearmonthnum", "yearmonth", "weeknuminyear"},
+      db.d.datekey,
+      db.d.year,
+      db.d.yearmonthnum,
+      db.d.yearmonth,
+      db.d.weeknuminyear);
+  total += log_table("lo",
+                     {"custkey",
+                      "partkey",
+                      "suppkey",
+                      "orderdate",
+                      "quantity",
+                      "extendedprice",
+                      "discount",
+                      "revenue",
+                      "supplycost"},
+                     db.lo.custkey,
+                     db.lo.partkey,
+                     db.lo.suppkey,
+                     db.lo.orderdate,
+                     db.lo.quantity,
+                     db.lo.extendedprice,
+                     db.lo.discount,
+                     db.lo.revenue,
+                     db.lo.supplycost);
+  for (const auto &[table, pt] : {std::pair("p_pt", &db.p_pt),
+                                   std::pair("c_pt", &db.c_pt)}) {
+    size_t bytes = allocated_bytes(pt->offsets);
+    log("Memory", table, bytes);
+    total += bytes;
+  }
+
+  log("Memory", "Database", total);
+}
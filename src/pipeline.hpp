@@ -0,0 +1,272 @@
+#pragma once
+
+#include "common.hpp"
+#include "hash_agg.hpp"
+#include "trace.hpp"
+
+#include "oneapi/tbb.h"
+
+#include <tuple>
+#include <type_traits>
+
+// Star-join pipelines over lineorder, written as
+//
+//   scan(lo)
+//       .filter([&](size_t i) { ... })
+//       .semijoin(hs_supplier, lo.suppkey)
+//       .join(hm_part, lo.partkey)
+//       .join(hm_date, lo.orderdate)
+//       .groupby<Key, 1, 0>()
+//       .sum(lo.revenue);
+//
+// or, to group by a column with many distinct values,
+//
+//       .groupby(lo.custkey, domain)
+//       .sum(lo.revenue);
+//
+// Each stage wraps the previous one and passes the values joined so far to a
+// continuation, so the whole pipeline inlines into one loop over lineorder,
+// like a hand-written probe. Joins append their value; groupby packs the
+// joined values at the given indexes, or all of them in order.
+//
+// Each stage also counts the bytes of lineorder it reads, its column at every
+// row that reaches it, for read_bytes().
+namespace pipeline {
+
+// The table a key is looked up in: the table itself, or its partition when
+// the table is partitioned.
+template <typename T> const T &table_of(const T &table, uint32_t) {
+  return table;
+}
+
+template <typename T>
+const T &table_of(const std::vector<T> &tables, uint32_t key) {
+  return tables[key % n_pt];
+}
+
+struct Rows {
+  template <typename K> void operator()(size_t, K &&k) const { k(); }
+
+  template <typename K> void count(size_t, size_t &, K &&k) const { k(); }
+};
+
+template <typename Prev, typename P> struct Filter {
+  Prev prev;
+  P pred;
+  // Bytes of a row pred reads.
+  size_t width;
+
+  template <typename K> void operator()(size_t i, K &&k) const {
+    prev(i, [&](auto... values) {
+      if (pred(i)) {
+        k(values...);
+      }
+    });
+  }
+
+  template <typename K> void count(size_t i, size_t &bytes, K &&k) const {
+    prev.count(i, bytes, [&] {
+      bytes += width;
+      if (pred(i)) {
+        k();
+      }
+    });
+  }
+};
+
+template <typename Prev, typename T> struct SemiJoin {
+  Prev prev;
+  const T &table;
+  const std::vector<uint32_t> &column;
+
+  template <typename K> void operator()(size_t i, K &&k) const {
+    prev(i, [&](auto... values) {
+      if (table_of(table, column[i]).contains(column[i])) {
+        k(values...);
+      }
+    });
+  }
+
+  template <typename K> void count(size_t i, size_t &bytes, K &&k) const {
+    prev.count(i, bytes, [&] {
+      bytes += sizeof(uint32_t);
+      if (table_of(table, column[i]).contains(column[i])) {
+        k();
+      }
+    });
+  }
+};
+
+template <typename Prev, typename T> struct Join {
+  Prev prev;
+  const T &table;
+  const std::vector<uint32_t> &column;
+
+  template <typename K> void operator()(size_t i, K &&k) const {
+    prev(i, [&](auto... values) {
+      const auto &t = table_of(table, column[i]);
+      auto it = t.find(column[i]);
+      if (it != t.end()) {
+        k(values..., it->second);
+      }
+    });
+  }
+
+  template <typename K> void count(size_t i, size_t &bytes, K &&k) const {
+    prev.count(i, bytes, [&] {
+      bytes += sizeof(uint32_t);
+      if (table_of(table, column[i]).contains(column[i])) {
+        k();
+      }
+    });
+  }
+};
+
+// The value a measure takes at row i: a column, or a function of the row.
+template <typename M> auto measure_of(const M &measure, size_t i) {
+  if constexpr (std::is_invocable_v<const M &, size_t>) {
+    return measure(i);
+  } else {
+    return measure[i];
+  }
+}
+
+template <typename Stages, typename Key, size_t... I> class Grouped {
+public:
+  Grouped(const Lineorder &lo, Stages stages) : lo(lo), stages(stages) {}
+
+  template <typename M> typename Key::accumulator sum(const M &measure) const {
+    return tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, lo.orderdate.size()),
+        Key::make(),
+        [&](const tbb::blocked_range<size_t> &r,
+            typename Key::accumulator acc) {
+          TraceSpan span("Morsel", r.begin(), r.end());
+          for (size_t i = r.begin(); i < r.end(); ++i) {
+            stages(i, [&](auto... values) {
+              Key::add(acc, pack(values...), measure_of(measure, i));
+            });
+          }
+          return acc;
+        },
+        Key::merge);
+  }
+
+private:
+  template <typename... V> static uint64_t pack(V... values) {
+    if constexpr (sizeof...(I) == 0) {
+      return Key::pack(values...);
+    } else {
+      std::tuple<V...> t(values...);
+      return Key::pack(std::get<I>(t)...);
+    }
+  }
+
+  const Lineorder &lo;
+  Stages stages;
+};
+
+template <typename Stages, typename G> class HashGrouped {
+public:
+  HashGrouped(const Lineorder &lo, Stages stages, const G &key, uint64_t domain)
+      : lo(lo), stages(stages), key(key), domain(domain) {}
+
+  template <typename M> GroupSums sum(const M &measure) const {
+    return aggregate(
+        lo.orderdate.size(), domain, [&](size_t begin, size_t end, auto &&add) {
+          for (size_t i = begin; i < end; ++i) {
+            stages(i, [&](auto...) {
+              add(measure_of(key, i), measure_of(measure, i));
+            });
+          }
+        });
+  }
+
+private:
+  const Lineorder &lo;
+  Stages stages;
+  const G &key;
+  uint64_t domain;
+};
+
+template <typename Stages> class Pipeline {
+public:
+  Pipeline(const Lineorder &lo, Stages stages) : lo(lo), stages(stages) {}
+
+  // Keeps the rows pred accepts. columns are the ones pred reads, which
+  // read_bytes() counts.
+  template <typename P, typename... T>
+  auto filter(P pred, const std::vector<T> &...columns) const {
+    return next(Filter<Stages, P>{stages, pred, (sizeof(T) + ... + 0)});
+  }
+
+  // Keeps the rows whose column value is in table.
+  template <typename T>
+  auto semijoin(const T &table, const std::vector<uint32_t> &column) const {
+    return next(SemiJoin<Stages, T>{stages, table, column});
+  }
+
+  // Keeps the rows whose column value is a key of table, appending the value
+  // it maps to.
+  template <typename T>
+  auto join(const T &table, const std::vector<uint32_t> &column) const {
+    return next(Join<Stages, T>{stages, table, column});
+  }
+
+  template <typename Key, size_t... I>
+  Grouped<Stages, Key, I...> groupby() const {
+    return {lo, stages};
+  }
+
+  // Groups by key, a column or a function of the row, whose values lie in
+  // [0, domain). The sums go into a dense accumulator if the domain is small
+  // and into partitioned hash tables otherwise.
+  template <typename G>
+  HashGrouped<Stages, G> groupby(const G &key, uint64_t domain) const {
+    return {lo, stages, key, domain};
+  }
+
+  // Sums measure over the surviving rows into a single-slot accumulator.
+  template <typename M> Accumulator sum(const M &measure) const {
+    int64_t sum = tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, lo.orderdate.size()),
+        int64_t(0),
+        [&](const tbb::blocked_range<size_t> &r, int64_t acc) {
+          TraceSpan span("Morsel", r.begin(), r.end());
+          for (size_t i = r.begin(); i < r.end(); ++i) {
+            stages(i, [&](auto...) { acc += measure_of(measure, i); });
+          }
+          return acc;
+        },
+        std::plus<>());
+    return {{true, sum}};
+  }
+
+  // Bytes of lineorder the pipeline reads: each stage's column at the rows
+  // that reach it, all of them for the first stage, then the measure columns
+  // at the rows that survive. measure lists the columns the aggregation reads
+  // that no stage did. Runs the stages' lookups without aggregating.
+  template <typename... T>
+  size_t read_bytes(const std::vector<T> &...measure) const {
+    return tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, lo.orderdate.size()),
+        size_t(0),
+        [&](const tbb::blocked_range<size_t> &r, size_t bytes) {
+          for (size_t i = r.begin(); i < r.end(); ++i) {
+            stages.count(i, bytes, [&] { bytes += (sizeof(T) + ... + 0); });
+          }
+          return bytes;
+        },
+        std::plus<>());
+  }
+
+private:
+  template <typename S> Pipeline<S> next(S s) const { return {lo, s}; }
+
+  const Lineorder &lo;
+  Stages stages;
+};
+
+inline Pipeline<Rows> scan(const Lineorder &lo) { return {lo, Rows()}; }
+
+} // namespace pipeline
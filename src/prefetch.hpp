@@ -0,0 +1,57 @@
+#pragma once
+
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+// Number of rows whose hash table lookups are in flight at once.
+constexpr size_t prefetch_group = 16;
+
+// One lookup of a probe: prefetch(i) starts loading the bucket row i needs,
+// and resolve(i, j) completes the lookup, storing any value in slot j, and
+// returns whether row i survives.
+template <typename P, typename R> struct Stage {
+  P prefetch;
+  R resolve;
+};
+
+template <typename P, typename R> Stage<P, R> stage(P prefetch, R resolve) {
+  return {prefetch, resolve};
+}
+
+// Probes rows [begin, end) in groups of prefetch_group rows, running each
+// stage over the whole group before the next so that the cache misses of a
+// group's lookups overlap. Calls f(i, j) for every row i that survives all
+// stages, where j is its slot in the group.
+template <typename F, typename... Stages>
+void probe_grouped(size_t begin, size_t end, F &&f, Stages &&...stages) {
+  TraceSpan span("PrefetchMorsel", begin, end);
+  uint8_t slots[prefetch_group];
+
+  for (size_t base = begin; base < end; base += prefetch_group) {
+    size_t n = std::min(prefetch_group, end - base);
+    for (size_t k = 0; k < n; ++k) {
+      slots[k] = uint8_t(k);
+    }
+
+    auto run = [&](auto &s) {
+      for (size_t k = 0; k < n; ++k) {
+        s.prefetch(base + slots[k]);
+      }
+      size_t m = 0;
+      for (size_t k = 0; k < n; ++k) {
+        if (s.resolve(base + slots[k], slots[k])) {
+          slots[m++] = slots[k];
+        }
+      }
+      n = m;
+    };
+    (run(stages), ...);
+
+    for (size_t k = 0; k < n; ++k) {
+      f(base + slots[k], slots[k]);
+    }
+  }
+}
@@ -0,0 +1,381 @@
+#include "prepared.hpp"
+#include "group_key.hpp"
+#include "pipeline.hpp"
+
+#include "oneapi/tbb.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <tuple>
+
+using Year = Dim<uint16_t, 1992, 1998>;
+
+// Any dictionary code.
+constexpr CodeRange any_code = {0, UINT32_MAX};
+
+// Assigns value to param and marks stale the table built from it, if it
+// changed.
+template <typename T> void rebind(T &param, const T &value, bool &stale) {
+  if (!(param == value)) {
+    param = value;
+    stale = true;
+  }
+}
+
+// The codes of value in dict, or any_code if value is empty. Throws if dict
+// has no such value, so that a misspelled parameter does not pass for one
+// matching nothing.
+CodeRange code_of(const Dictionary &dict,
+                  const std::string &what,
+                  const std::string &value) {
+  if (value.empty()) {
+    return any_code;
+  }
+  CodeRange range = dict.equal(value);
+  if (range.empty()) {
+    throw std::runtime_error("unknown " + what + " " + value);
+  }
+  return range;
+}
+
+// Throws unless the years of d lie in the Year domain the prepared queries
+// group by.
+void check_years(const Date &d) {
+  if (d.year.empty()) {
+    throw std::runtime_error("date table not loaded");
+  }
+  auto [min, max] = std::minmax_element(d.year.begin(), d.year.end());
+  check_domain<Year>({*min, uint32_t(*max) + 1});
+}
+
+template <typename T>
+void build_date(const Database &db, YearRange years, T &table) {
+  table.clear();
+  for (size_t i = 0; i < db.d.datekey.size(); ++i) {
+    if (db.d.year[i] >= years.first && db.d.year[i] <= years.last) {
+      table.emplace(db.d.datekey[i], db.d.year[i]);
+    }
+  }
+}
+
+void load_database(const char *path, Database &db) {
+  load_dimensions(path, db);
+  load_lineorder(path, db.lo);
+}
+
+PreparedQ1::PreparedQ1(const Database &db) : db(db) {}
+
+void PreparedQ1::bind_years(YearRange years) {
+  rebind(this->years, years, date_stale);
+}
+
+void PreparedQ1::bind_discount(uint8_t first, uint8_t last) {
+  discount_first = first;
+  discount_last = last;
+}
+
+void PreparedQ1::bind_quantity(uint8_t first, uint8_t last) {
+  quantity_first = first;
+  quantity_last = last;
+}
+
+ColumnSet PreparedQ1::columns() const {
+  return col::d_datekey | col::d_year | col::lo_orderdate | col::lo_quantity |
+         col::lo_extendedprice | col::lo_discount;
+}
+
+std::vector<PreparedQ1::Row> PreparedQ1::execute() {
+  double latency;
+
+  if (date_stale) {
+    latency = time([&] { build_date(db, years, hs_date); });
+    log("PreparedQ1", "BuildHashSetDate", latency);
+    date_stale = false;
+  }
+
+  const Lineorder &lo = db.lo;
+  Accumulator acc;
+  latency = time([&] {
+    acc = pipeline::scan(lo)
+              .filter([&](size_t i) {
+                return lo.discount[i] >= discount_first &&
+                       lo.discount[i] <= discount_last &&
+                       lo.quantity[i] >= quantity_first &&
+                       lo.quantity[i] <= quantity_last;
+              })
+              .semijoin(hs_date, lo.orderdate)
+              .sum([&](size_t i) {
+                return lo.extendedprice[i] * lo.discount[i];
+              });
+  });
+  log("PreparedQ1", "Probe", latency);
+
+  return {{acc[0].second}};
+}
+
+// Brand codes, which SSB numbers from 1 to 1000.
+using Brand = Dim<uint16_t, 0, 1023>;
+using Q2Key = GroupKey<Year, Brand>;
+
+PreparedQ2::PreparedQ2(const Database &db)
+    : db(db), region(any_code), category(any_code), brands(any_code),
+      hm_part(n_pt) {
+  check_years(db.d);
+  check_domain<Brand>(db.dicts.brand1.prefix(""));
+}
+
+void PreparedQ2::bind_region(const std::string &region) {
+  rebind(this->region,
+         code_of(db.dicts.region, "region", region),
+         supplier_stale);
+}
+
+void PreparedQ2::bind_category(const std::string &category) {
+  rebind(this->category,
+         code_of(db.dicts.category, "category", category),
+         part_stale);
+}
+
+void PreparedQ2::bind_brands(const std::string &low, const std::string &high) {
+  CodeRange brands = low.empty() && high.empty()
+                         ? any_code
+                         : db.dicts.brand1.between(low, high);
+  rebind(this->brands, brands, part_stale);
+}
+
+void PreparedQ2::bind_years(YearRange years) {
+  rebind(this->years, years, date_stale);
+}
+
+ColumnSet PreparedQ2::columns() const {
+  return col::s_suppkey | col::s_region | col::p_partkey | col::p_category |
+         col::p_brand1 | col::d_datekey | col::d_year | col::lo_partkey |
+         col::lo_suppkey | col::lo_orderdate | col::lo_revenue;
+}
+
+std::vector<PreparedQ2::Row> PreparedQ2::execute() {
+  double latency;
+
+  if (supplier_stale) {
+    latency = time([&] {
+      hs_supplier.clear();
+      for (size_t i = 0; i < db.s.suppkey.size(); ++i) {
+        if (region.contains(db.s.region[i])) {
+          hs_supplier.insert(db.s.suppkey[i]);
+        }
+      }
+    });
+    log("PreparedQ2", "BuildHashSetSupplier", latency);
+    supplier_stale = false;
+  }
+
+  if (part_stale) {
+    latency = time([&] {
+      tbb::parallel_for(size_t(0), n_pt, [&](size_t i) {
+        hm_part[i].clear();
+        for (size_t j = db.p_pt.begin(i); j < db.p_pt.end(i); ++j) {
+          if (category.contains(db.p.category[j]) &&
+              brands.contains(db.p.brand1[j])) {
+            hm_part[i].emplace(db.p.partkey[j], db.p.brand1[j]);
+          }
+        }
+      });
+    });
+    log("PreparedQ2", "BuildHashMapPart", latency);
+    part_stale = false;
+  }
+
+  if (date_stale) {
+    latency = time([&] { build_date(db, years, hm_date); });
+    log("PreparedQ2", "BuildHashMapDate", latency);
+    date_stale = false;
+  }
+
+  const Lineorder &lo = db.lo;
+  Q2Key::accumulator acc;
+  latency = time([&] {
+    acc = pipeline::scan(lo)
+              .semijoin(hs_supplier, lo.suppkey)
+              .join(hm_part, lo.partkey)
+              .join(hm_date, lo.orderdate)
+              .groupby<Q2Key, 1, 0>()
+              .sum(lo.revenue);
+  });
+  log("PreparedQ2", "Probe", latency);
+
+  std::vector<std::tuple<uint16_t, uint16_t, int64_t>> groups;
+  Q2Key::decode(acc, groups);
+
+  std::vector<Row> result;
+  result.reserve(groups.size());
+  for (const auto &[year, brand, revenue] : groups) {
+    result.push_back({year, db.dicts.brand1.value(brand), revenue});
+  }
+  return result;
+}
+
+// Place codes. Regions and nations, 5 and 25 in SSB, are narrow enough for a
+// dense key by customer, supplier and year; cities, 250, take a byte each
+// and need a hash accumulator.
+using NationCode = Dim<uint8_t, 0, 31>;
+using CityCode = Dim<uint8_t, 0, UINT8_MAX>;
+using Q3NationKey = GroupKey<NationCode, NationCode, Year>;
+using Q3CityKey = GroupKey<CityCode, CityCode, Year>;
+
+static_assert(Q3NationKey::dense);
+
+const Dictionary &dictionary_of(const Dictionaries &dicts,
+                               Place::Level level) {
+  switch (level) {
+  case Place::region:
+    return dicts.region;
+  case Place::nation:
+    return dicts.nation;
+  case Place::city:
+    return dicts.city;
+  }
+  throw std::runtime_error("unknown place level");
+}
+
+// The column of level in a table of customers or suppliers.
+template <typename T>
+const std::vector<uint8_t> &column_of(const T &table, Place::Level level) {
+  switch (level) {
+  case Place::region:
+    return table.region;
+  case Place::nation:
+    return table.nation;
+  case Place::city:
+    return table.city;
+  }
+  throw std::runtime_error("unknown place level");
+}
+
+// The codes of the values of place.
+std::vector<CodeRange> codes_of(const Dictionaries &dicts,
+                                const Place &place) {
+  static const char *const names[] = {"region", "nation", "city"};
+  const Dictionary &dict = dictionary_of(dicts, place.level);
+
+  std::vector<CodeRange> codes;
+  for (const std::string &value : place.values) {
+    codes.push_back(code_of(dict, names[place.level], value));
+  }
+  return codes;
+}
+
+bool any_contains(const std::vector<CodeRange> &codes, uint32_t code) {
+  if (codes.empty()) {
+    return true;
+  }
+  return std::any_of(codes.begin(), codes.end(), [&](const CodeRange &range) {
+    return range.contains(code);
+  });
+}
+
+PreparedQ3::PreparedQ3(const Database &db, Place::Level group_by)
+    : db(db), group_by(group_by), hm_customer(n_pt) {
+  check_years(db.d);
+  if (group_by != Place::city) {
+    check_domain<NationCode>(dictionary_of(db.dicts, group_by).prefix(""));
+  }
+}
+
+void PreparedQ3::bind_customer(Place place) {
+  codes_of(db.dicts, place);
+  rebind(customer, place, customer_stale);
+}
+
+void PreparedQ3::bind_supplier(Place place) {
+  codes_of(db.dicts, place);
+  rebind(supplier, place, supplier_stale);
+}
+
+void PreparedQ3::bind_years(YearRange years) {
+  rebind(this->years, years, date_stale);
+}
+
+ColumnSet PreparedQ3::columns() const {
+  return col::customer | col::s_suppkey | col::s_city | col::s_nation |
+         col::s_region | col::d_datekey | col::d_year | col::lo_custkey |
+         col::lo_suppkey | col::lo_orderdate | col::lo_revenue;
+}
+
+template <typename Key>
+std::vector<PreparedQ3::Row> PreparedQ3::probe() const {
+  const Lineorder &lo = db.lo;
+  typename Key::accumulator acc;
+  double latency = time([&] {
+    acc = pipeline::scan(lo)
+              .join(hm_customer, lo.custkey)
+              .join(hm_supplier, lo.suppkey)
+              .join(hm_date, lo.orderdate)
+              .template groupby<Key>()
+              .sum(lo.revenue);
+  });
+  log("PreparedQ3", "Probe", latency);
+
+  std::vector<std::tuple<uint8_t, uint8_t, uint16_t, int64_t>> groups;
+  Key::decode(acc, groups);
+
+  const Dictionary &dict = dictionary_of(db.dicts, group_by);
+  std::vector<Row> result;
+  result.reserve(groups.size());
+  for (const auto &[c_place, s_place, year, revenue] : groups) {
+    result.push_back(
+        {dict.value(c_place), dict.value(s_place), year, revenue});
+  }
+  return result;
+}
+
+std::vector<PreparedQ3::Row> PreparedQ3::execute() {
+  double latency;
+
+  if (customer_stale) {
+    std::vector<CodeRange> codes = codes_of(db.dicts, customer);
+    const std::vector<uint8_t> &filter = column_of(db.c, customer.level);
+    const std::vector<uint8_t> &group = column_of(db.c, group_by);
+    latency = time([&] {
+      tbb::parallel_for(size_t(0), n_pt, [&](size_t i) {
+        hm_customer[i].clear();
+        for (size_t j = db.c_pt.begin(i); j < db.c_pt.end(i); ++j) {
+          if (any_contains(codes, filter[j])) {
+            hm_customer[i].emplace(db.c.custkey[j], group[j]);
+          }
+        }
+      });
+    });
+    log("PreparedQ3", "BuildHashMapCustomer", latency);
+    customer_stale = false;
+  }
+
+  if (supplier_stale) {
+    std::vector<CodeRange> codes = codes_of(db.dicts, supplier);
+    const std::vector<uint8_t> &filter = column_of(db.s, supplier.level);
+    const std::vector<uint8_t> &group = column_of(db.s, group_by);
+    latency = time([&] {
+      hm_supplier.clear();
+      for (size_t i = 0; i < db.s.suppkey.size(); ++i) {
+        if (any_contains(codes, filter[i])) {
+          hm_supplier.emplace(db.s.suppkey[i], group[i]);
+        }
+      }
+    });
+    log("PreparedQ3", "BuildHashMapSupplier", latency);
+    supplier_stale = false;
+  }
+
+  if (date_stale) {
+    latency = time([&] { build_date(db, years, hm_date); });
+    log("PreparedQ3", "BuildHashMapDate", latency);
+    date_stale = false;
+  }
+
+  std::vector<Row> result =
+      group_by == Place::city ? probe<Q3CityKey>() : probe<Q3NationKey>();
+  std::sort(result.begin(), result.end(), [](const Row &a, const Row &b) {
+    return a.d_year < b.d_year ||
+           (a.d_year == b.d_year && a.revenue > b.revenue);
+  });
+  return result;
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <string>
+#include <vector>
+
+// The interface of the ssb library, for programs that embed the engine: a
+// database loader and the query flights as prepared queries whose constants
+// are parameters. A prepared query keeps its dimension tables between
+// executions and rebuilds only those whose parameters were re-bound since the
+// last one, so a series of calls differing in one predicate pays for one
+// dimension. Results come back as rows of decoded values.
+//
+// A prepared query reads the Database it was constructed on, which must
+// outlive it, and must not be executed from two threads at once.
+
+// Loads the dimension tables, their dictionaries and lineorder.
+void load_database(const char *path, Database &db);
+
+// A closed range of years, which matches every year of SSB by default.
+struct YearRange {
+  uint16_t first = 1992;
+  uint16_t last = 1998;
+
+  friend bool operator==(const YearRange &a, const YearRange &b) {
+    return a.first == b.first && a.last == b.last;
+  }
+};
+
+// A predicate on where customers or suppliers are: their region, nation or
+// city is one of values. Matches everyone if values is empty.
+struct Place {
+  enum Level { region, nation, city };
+
+  Level level = region;
+  std::vector<std::string> values;
+
+  friend bool operator==(const Place &a, const Place &b) {
+    return a.level == b.level && a.values == b.values;
+  }
+};
+
+// Flight 1: the revenue lost to discounts in a range on lineorder rows of
+// quantities in a range, in a range of years. Discount and quantity filter
+// lineorder itself, so only the years rebuild a table.
+class PreparedQ1 {
+public:
+  struct Row {
+    int64_t revenue;
+  };
+
+  explicit PreparedQ1(const Database &db);
+
+  void bind_years(YearRange years);
+
+  // Discounts and quantities in [first, last].
+  void bind_discount(uint8_t first, uint8_t last);
+  void bind_quantity(uint8_t first, uint8_t last);
+
+  ColumnSet columns() const;
+
+  // Rebuilds the date table if its parameters changed, then probes
+  // lineorder. Returns a single row.
+  std::vector<Row> execute();
+
+private:
+  const Database &db;
+
+  YearRange years;
+  uint8_t discount_first = 0;
+  uint8_t discount_last = UINT8_MAX;
+  uint8_t quantity_first = 0;
+  uint8_t quantity_last = UINT8_MAX;
+
+  bool date_stale = true;
+  hash_set<uint32_t> hs_date;
+};
+
+// Flight 2: revenue by year and brand, for parts of a category or a range of
+// brands sold by suppliers of a region, in a range of years.
+class PreparedQ2 {
+public:
+  struct Row {
+    uint16_t d_year;
+    std::string p_brand1;
+    int64_t revenue;
+  };
+
+  explicit PreparedQ2(const Database &db);
+
+  // Suppliers of region, or all if empty.
+  void bind_region(const std::string &region);
+
+  // Parts of category, or all if empty, and with a brand in [low, high], or
+  // any if both are empty.
+  void bind_category(const std::string &category);
+  void bind_brands(const std::string &low, const std::string &high);
+
+  void bind_years(YearRange years);
+
+  ColumnSet columns() const;
+
+  // Rebuilds the dimension tables whose parameters changed, then probes
+  // lineorder. Rows are ordered by year and brand.
+  std::vector<Row> execute();
+
+private:
+  const Database &db;
+
+  CodeRange region;
+  CodeRange category;
+  CodeRange brands;
+  YearRange years;
+
+  bool supplier_stale = true;
+  bool part_stale = true;
+  bool date_stale = true;
+  hash_set<uint32_t> hs_supplier;
+  std::vector<hash_map<uint32_t, uint16_t>> hm_part;
+  hash_map<uint32_t, uint16_t> hm_date;
+};
+
+// Flight 3: revenue by customer place, supplier place and year, for
+// customers and suppliers matching a Place each, in a range of years. Places
+// are grouped at the level given at construction.
+class PreparedQ3 {
+public:
+  struct Row {
+    std::string c_place;
+    std::string s_place;
+    uint16_t d_year;
+    int64_t revenue;
+  };
+
+  PreparedQ3(const Database &db, Place::Level group_by);
+
+  void bind_customer(Place place);
+  void bind_supplier(Place place);
+  void bind_years(YearRange years);
+
+  ColumnSet columns() const;
+
+  // Rebuilds the dimension tables whose parameters changed, then probes
+  // lineorder. Rows are ordered by year, then by revenue, descending.
+  std::vector<Row> execute();
+
+private:
+  // Probes lineorder and decodes the groups, packed by Key.
+  template <typename Key> std::vector<Row> probe() const;
+
+  const Database &db;
+  Place::Level group_by;
+
+  Place customer;
+  Place supplier;
+  YearRange years;
+
+  bool customer_stale = true;
+  bool supplier_stale = true;
+  bool date_stale = true;
+  std::vector<hash_map<uint32_t, uint8_t>> hm_customer;
+  hash_map<uint32_t, uint8_t> hm_supplier;
+  hash_map<uint32_t, uint16_t> hm_date;
+};
@@ -1,93 +1,254 @@
-#include "../common.hpp"
+#include "../bitmap.hpp"
+#include "../cube.hpp"
+#include "../pipeline.hpp"
+#include "../prefetch.hpp"
+#include "../query.hpp"
 
 #include "oneapi/tbb.h"
 
-template <typename C1, typename C2>
-void q1(const std::string &query, const Database &db, C1 &&c1, C2 &&c2) {
-  double latency;
-  uint64_t result;
+namespace SSB_ISA {
 
-  hash_set<uint32_t> hs;
-  latency = time([&] {
-    for (size_t i = 0; i < db.d.datekey.size(); ++i) {
-      if (c1(i)) {
-        hs.insert(db.d.datekey[i]);
+template <typename C1, typename C2> class Q1 : public Query {
+public:
+  Q1(std::string name, const Database &db, C1 c1, C2 c2)
+      : Query(std::move(name)), db(db), c1(c1), c2(c2) {}
+
+  ColumnSet columns() const override {
+    return col::d_datekey | col::d_year | col::d_yearmonthnum |
+           col::d_weeknuminyear | col::lo_orderdate | col::lo_quantity |
+           col::lo_extendedprice | col::lo_discount;
+  }
+
+  void build() override {
+    double latency;
+
+    latency = time([&] {
+      for (size_t i = 0; i < db.d.datekey.size(); ++i) {
+        if (c1(db.d.year[i],
+               db.d.yearmonthnum[i],
+               db.d.weeknuminyear[i])) {
+          hs.insert(db.d.datekey[i]);
+        }
+      }
+    });
+
+    log(name, "BuildHashSetDate", latency);
+  }
+
+  void log_bytes() const override {
+    log(name, "HashSetDateBytes", allocated_bytes(hs));
+  }
+
+  // The probe's filters and joins over lo, in order.
+  auto stages(const Lineorder &lo) const {
+    return pipeline::scan(lo)
+        .filter([&](size_t i) { return c2(lo.discount[i], lo.quantity[i]); },
+                lo.discount,
+                lo.quantity)
+        .semijoin(hs, lo.orderdate);
+  }
+
+  Accumulator probe(const Lineorder &lo) const override {
+    if (prefetch) {
+      return probe_prefetched(lo);
+    }
+
+    return stages(lo).sum(
+        [&](size_t i) { return lo.extendedprice[i] * lo.discount[i]; });
+  }
+
+  size_t probe_bytes(const Lineorder &lo) const override {
+    return stages(lo).read_bytes(lo.extendedprice);
+  }
+
+  Accumulator agg(const Lineorder &lo) const override {
+    double latency;
+    uint64_t sum;
+
+    std::vector<size_t> idx;
+    for (size_t i = 0; i < lo.orderdate.size(); ++i) {
+      if (c2(lo.discount[i], lo.quantity[i]) && hs.contains(lo.orderdate[i])) {
+        idx.push_back(i);
       }
     }
-  });
 
-  log(query, "BuildHashSetDate", latency);
+    latency = time([&] {
+      sum = tbb::parallel_reduce(
+          tbb::blocked_range<size_t>(0, idx.size()),
+          uint64_t(0),
+          [&](const tbb::blocked_range<size_t> &r, uint64_t acc) {
+            for (size_t j = r.begin(); j < r.end(); ++j) {
+              size_t i = idx[j];
+              acc += lo.extendedprice[i] * lo.discount[i];
+            }
+            return acc;
+          },
+          std::plus<>());
+    });
+
+    log(name, "Agg", latency);
+    log(name, "AggInputBytes", allocated_bytes(idx));
+    // The row indexes, and the two columns gathered at each.
+    log_bandwidth(name,
+                  "Agg",
+                  idx.size() * (sizeof(size_t) + sizeof(uint32_t) +
+                                sizeof(uint8_t)),
+                  latency);
+
+    return {{true, int64_t(sum)}};
+  }
 
-  latency = time([&] {
-    result = tbb::parallel_reduce(
-        tbb::blocked_range<size_t>(0, db.lo.orderdate.size()),
+  Accumulator scan(const Lineorder &lo,
+                   const LineorderDims &dims) const override {
+    uint64_t sum = tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, lo.orderdate.size()),
         uint64_t(0),
         [&](const tbb::blocked_range<size_t> &r, uint64_t acc) {
           for (size_t i = r.begin(); i < r.end(); ++i) {
-            if (c2(i) && hs.contains(db.lo.orderdate[i])) {
-              acc += db.lo.extendedprice[i] * db.lo.discount[i];
+            if (c2(lo.discount[i], lo.quantity[i]) &&
+                c1(dims.d_year[i],
+                   dims.d_yearmonthnum[i],
+                   dims.d_weeknuminyear[i])) {
+              acc += lo.extendedprice[i] * lo.discount[i];
             }
           }
           return acc;
         },
         std::plus<>());
-  });
+    return {{true, int64_t(sum)}};
+  }
 
-  log(query, "Probe", latency);
+  size_t scan_bytes(const LineorderDims &dims) const override {
+    return column_bytes(
+        dims.d_year, dims.d_yearmonthnum, dims.d_weeknuminyear);
+  }
 
-  std::cout << result << std::endl;
+  Bitmap filter(const BitmapIndex &index) const override {
+    auto discount = [&](uint32_t d) {
+      for (const auto &[q, bitmap] : index.lo_quantity) {
+        if (c2(d, q)) {
+          return true;
+        }
+      }
+      return false;
+    };
+    auto quantity = [&](uint32_t q) {
+      for (const auto &[d, bitmap] : index.lo_discount) {
+        if (c2(d, q)) {
+          return true;
+        }
+      }
+      return false;
+    };
+    return select(index.d_yearmonthnum,
+                  db.d.yearmonthnum,
+                  [&](size_t i) {
+                    return c1(db.d.year[i],
+                              db.d.yearmonthnum[i],
+                              db.d.weeknuminyear[i]);
+                  }) &
+           select(index.lo_discount, discount) &
+           select(index.lo_quantity, quantity);
+  }
 
-  std::vector<size_t> idx;
-  for (size_t i = 0; i < db.lo.orderdate.size(); ++i) {
-    if (c2(i) && hs.contains(db.lo.orderdate[i])) {
-      idx.push_back(i);
+  bool rollup(const Cubes &cubes, Accumulator &acc) const override {
+    std::vector<std::vector<int32_t>> values(3);
+    if (!classify(db.d.datekey,
+                  cubes.d_week,
+                  [&](uint32_t key) { return member(hs, key); },
+                  values[0])) {
+      return false;
     }
+    values[1] = codes(cubes.q1.shape[1]);
+    values[2] = codes(cubes.q1.shape[2]);
+
+    int64_t sum = 0;
+    ::rollup(cubes.q1, values, [&](const int32_t *cell, int64_t cell_sum) {
+      if (c2(cell[1], cell[2])) {
+        sum += cell_sum;
+      }
+    });
+    acc = {{true, sum}};
+    return true;
+  }
+
+  void finalize(const Accumulator &acc) override { result = acc[0].second; }
+
+  void print() const override { std::cout << result << std::endl; }
+
+  std::vector<std::string> rows() const override {
+    return {std::to_string(result)};
   }
 
-  latency = time([&] {
-    result = tbb::parallel_reduce(
-        tbb::blocked_range<size_t>(0, idx.size()),
+  size_t slot(size_t i) const override { return 0; }
+
+private:
+  Accumulator probe_prefetched(const Lineorder &lo) const {
+    uint64_t sum = tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, lo.orderdate.size()),
         uint64_t(0),
         [&](const tbb::blocked_range<size_t> &r, uint64_t acc) {
-          for (size_t j = r.begin(); j < r.end(); ++j) {
-            size_t i = idx[j];
-            acc += db.lo.extendedprice[i] * db.lo.discount[i];
-          }
+          probe_grouped(
+              r.begin(),
+              r.end(),
+              [&](size_t i, size_t) {
+                acc += lo.extendedprice[i] * lo.discount[i];
+              },
+              stage([&](size_t i) {},
+                    [&](size_t i, size_t) {
+                      return c2(lo.discount[i], lo.quantity[i]);
+                    }),
+              stage([&](size_t i) { hs.prefetch(lo.orderdate[i]); },
+                    [&](size_t i, size_t) {
+                      return hs.contains(lo.orderdate[i]);
+                    }));
           return acc;
         },
         std::plus<>());
-  });
+    return {{true, int64_t(sum)}};
+  }
 
-  log(query, "Agg", latency);
+  const Database &db;
+  C1 c1;
+  C2 c2;
+  hash_set<uint32_t> hs;
+  uint64_t result = 0;
+};
 
-  std::cout << result << std::endl;
+template <typename C1, typename C2>
+std::unique_ptr<Query>
+q1(std::string name, const Database &db, C1 c1, C2 c2) {
+  return std::make_unique<Q1<C1, C2>>(std::move(name), db, c1, c2);
 }
 
-void q1p1(const Database &db) {
-  auto c1 = [&](size_t i) { return db.d.year[i] == 1993; };
-  auto c2 = [&](size_t i) {
-    return db.lo.discount[i] >= 1 && db.lo.discount[i] <= 3 &&
-           db.lo.quantity[i] < 25;
+std::unique_ptr<Query> q1p1(const Database &db) {
+  auto c1 = [](uint16_t year, uint32_t yearmonthnum, uint8_t weeknuminyear) {
+    return year == 1993;
+  };
+  auto c2 = [](uint8_t discount, uint8_t quantity) {
+    return discount >= 1 && discount <= 3 && quantity < 25;
   };
-  q1("Q1.1", db, c1, c2);
+  return q1("Q1.1", db, c1, c2);
 }
 
-void q1p2(const Database &db) {
-  auto c1 = [&](size_t i) { return db.d.yearmonthnum[i] == 199401; };
-  auto c2 = [&](size_t i) {
-    return db.lo.discount[i] >= 4 && db.lo.discount[i] <= 6 &&
-           db.lo.quantity[i] >= 26 && db.lo.quantity[i] <= 35;
+std::unique_ptr<Query> q1p2(const Database &db) {
+  auto c1 = [](uint16_t year, uint32_t yearmonthnum, uint8_t weeknuminyear) {
+    return yearmonthnum == 199401;
   };
-  q1("Q1.2", db, c1, c2);
+  auto c2 = [](uint8_t discount, uint8_t quantity) {
+    return discount >= 4 && discount <= 6 && quantity >= 26 && quantity <= 35;
+  };
+  return q1("Q1.2", db, c1, c2);
 }
 
-void q1p3(const Database &db) {
-  auto c1 = [&](size_t i) {
-    return db.d.weeknuminyear[i] == 6 && db.d.year[i] == 1994;
+std::unique_ptr<Query> q1p3(const Database &db) {
+  auto c1 = [](uint16_t year, uint32_t yearmonthnum, uint8_t weeknuminyear) {
+    return weeknuminyear == 6 && year == 1994;
   };
-  auto c2 = [&](size_t i) {
-    return db.lo.discount[i] >= 5 && db.lo.discount[i] <= 7 &&
-           db.lo.quantity[i] >= 36 && db.lo.quantity[i] <= 40;
+  auto c2 = [](uint8_t discount, uint8_t quantity) {
+    return discount >= 5 && discount <= 7 && quantity >= 36 && quantity <= 40;
   };
-  q1("Q1.3", db, c1, c2);
+  return q1("Q1.3", db, c1, c2);
 }
+
+} // namespace SSB_ISA
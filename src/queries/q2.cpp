@@ -1,9 +1,16 @@
-#include "../common.hpp"
+#include "../bitmap.hpp"
+#include "../cube.hpp"
+#include "../group_key.hpp"
+#include "../pipeline.hpp"
+#include "../prefetch.hpp"
+#include "../query.hpp"
 
 #include "oneapi/tbb.h"
 
 #include <iomanip>
 
+namespace SSB_ISA {
+
 struct Q2Row {
   Q2Row(uint16_t d_year, uint16_t p_brand1, uint32_t sum_lo_revenue)
       : d_year(d_year), p_brand1(p_brand1), sum_lo_revenue(sum_lo_revenue) {}
@@ -24,14 +31,12 @@ struct Q2Row {
   uint32_t sum_lo_revenue;
 };
 
-void q2_finalize(Accumulator &acc, std::vector<Q2Row> &result) {
+template <typename Key>
+void q2_finalize(const typename Key::accumulator &acc,
+                 std::vector<Q2Row> &result) {
   result.clear();
 
-  for (size_t i = 0; i < acc.size(); ++i) {
-    if (acc[i].first) {
-      result.emplace_back((i >> 6) + 1992, (i & 0b111111) + 40, acc[i].second);
-    }
-  }
+  Key::decode(acc, result);
 
   std::sort(result.begin(), result.end(), [](const Q2Row &a, const Q2Row &b) {
     return a.d_year < b.d_year ||
@@ -39,134 +44,282 @@ void q2_finalize(Accumulator &acc, std::vector<Q2Row> &result) {
   });
 }
 
-template <typename C1, typename C2>
-void q2(const std::string &query, const Database &db, C1 &&c1, C2 &&c2) {
-  double latency;
-  std::vector<Q2Row> result;
+template <typename Key, typename C1, typename C2>
+class Q2 : public RowQuery<Q2Row> {
+  static_assert(Key::dense);
 
-  hash_set<uint32_t> hs_supplier;
+public:
+  Q2(std::string name, const Database &db, C1 c1, C2 c2)
+      : RowQuery(std::move(name)), db(db), c1(c1), c2(c2), hm_part(n_pt) {}
 
-  latency = time([&] {
-    for (size_t i = 0; i < db.s.suppkey.size(); ++i) {
-      if (c1(i)) {
-        hs_supplier.insert(db.s.suppkey[i]);
+  ColumnSet columns() const override {
+    return col::s_suppkey | col::s_region | col::p_partkey | col::p_category |
+           col::p_brand1 | col::d_datekey | col::d_year | col::lo_partkey |
+           col::lo_suppkey | col::lo_orderdate | col::lo_revenue;
+  }
+
+  void build() override {
+    double latency;
+
+    latency = time([&] {
+      for (size_t i = 0; i < db.s.suppkey.size(); ++i) {
+        if (c1(db.s.region[i])) {
+          hs_supplier.insert(db.s.suppkey[i]);
+        }
       }
-    }
-  });
+    });
 
-  log(query, "BuildHashSetSupplier", latency);
+    log(name, "BuildHashSetSupplier", latency);
 
-  std::vector<hash_map<uint32_t, uint16_t>> hm_part(n_pt);
-  latency = time([&] {
-    tbb::parallel_for(size_t(0), n_pt, [&](size_t i) {
-      const Part &p_pt = db.p_pt[i];
-      for (size_t j = 0; j < p_pt.partkey.size(); ++j) {
-        if (c2(i, j)) {
-          hm_part[i].emplace(p_pt.partkey[j], p_pt.brand1[j]);
+    latency = time([&] {
+      tbb::parallel_for(size_t(0), n_pt, [&](size_t i) {
+        for (size_t j = db.p_pt.begin(i); j < db.p_pt.end(i); ++j) {
+          if (c2(db.p.category[j], db.p.brand1[j])) {
+            hm_part[i].emplace(db.p.partkey[j], db.p.brand1[j]);
+          }
         }
+      });
+    });
+
+    log(name, "BuildHashMapPart", latency);
+
+    hm_date.reserve(db.d.datekey.size());
+
+    latency = time([&] {
+      for (size_t i = 0; i < db.d.datekey.size(); ++i) {
+        hm_date.emplace(db.d.datekey[i], db.d.year[i]);
       }
     });
-  });
 
-  log(query, "BuildHashMapPart", latency);
+    log(name, "BuildHashMapDate", latency);
+  }
 
-  hash_map<uint32_t, uint16_t> hm_date;
-  hm_date.reserve(db.d.datekey.size());
+  void log_bytes() const override {
+    log(name, "HashSetSupplierBytes", allocated_bytes(hs_supplier));
+    log(name, "HashMapPartBytes", allocated_bytes(hm_part));
+    log(name, "HashMapDateBytes", allocated_bytes(hm_date));
+    log(name, "AccumulatorBytes", Key::bytes);
+  }
+
+  // The probe's joins over lo, in order.
+  auto stages(const Lineorder &lo) const {
+    return pipeline::scan(lo)
+        .semijoin(hs_supplier, lo.suppkey)
+        .join(hm_part, lo.partkey)
+        .join(hm_date, lo.orderdate);
+  }
 
-  latency = time([&] {
-    for (size_t i = 0; i < db.d.datekey.size(); ++i) {
-      hm_date.emplace(db.d.datekey[i], db.d.year[i]);
+  Accumulator probe(const Lineorder &lo) const override {
+    if (prefetch) {
+      return probe_prefetched(lo);
     }
-  });
 
-  log(query, "BuildHashMapDate", latency);
+    return stages(lo).template groupby<Key, 1, 0>().sum(lo.revenue);
+  }
+
+  size_t probe_bytes(const Lineorder &lo) const override {
+    return stages(lo).read_bytes(lo.revenue);
+  }
+
+  Accumulator agg(const Lineorder &lo) const override {
+    double latency;
+    Accumulator acc;
+
+    std::vector<std::tuple<uint32_t, uint16_t, uint16_t>> agg_input;
+    for (size_t i = 0; i < lo.orderdate.size(); ++i) {
+      auto &hm_part_pt = hm_part[lo.partkey[i] % n_pt];
+      auto part_it = hm_part_pt.find(lo.partkey[i]);
+      if (part_it != hm_part_pt.end() && hs_supplier.contains(lo.suppkey[i])) {
+        auto date_it = hm_date.find(lo.orderdate[i]);
+        if (date_it != hm_date.end()) {
+          agg_input.emplace_back(
+              lo.revenue[i], date_it->second, part_it->second);
+        }
+      }
+    }
+
+    latency = time([&] {
+      acc = tbb::parallel_reduce(
+          tbb::blocked_range<size_t>(0, agg_input.size()),
+          Key::make(),
+          [&agg_input](const tbb::blocked_range<size_t> &r, Accumulator acc) {
+            for (size_t i = r.begin(); i < r.end(); ++i) {
+              auto &[lo_revenue, d_year, p_brand1] = agg_input[i];
+              Key::add(acc, Key::pack(d_year, p_brand1), lo_revenue);
+            }
+            return acc;
+          },
+          Key::merge);
+    });
+
+    log(name, "Agg", latency);
+    log(name, "AggInputBytes", allocated_bytes(agg_input));
+    log_bandwidth(name, "Agg", column_bytes(agg_input), latency);
+
+    return acc;
+  }
 
-  Accumulator acc;
-  latency = time([&] {
-    acc = tbb::parallel_reduce(
-        tbb::blocked_range<size_t>(0, db.lo.orderdate.size()),
-        Accumulator(512),
+  Accumulator scan(const Lineorder &lo,
+                   const LineorderDims &dims) const override {
+    return tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, lo.orderdate.size()),
+        Key::make(),
         [&](const tbb::blocked_range<size_t> &r, Accumulator acc) {
           for (size_t i = r.begin(); i < r.end(); ++i) {
-            if (hs_supplier.contains(db.lo.suppkey[i])) {
-              auto &hm_part_pt = hm_part[db.lo.partkey[i] % n_pt];
-              auto part_it = hm_part_pt.find(db.lo.partkey[i]);
-              if (part_it != hm_part_pt.end()) {
-                auto date_it = hm_date.find(db.lo.orderdate[i]);
-                std::pair<bool, int64_t> &slot =
-                    acc[((date_it->second - 1992) << 6) |
-                        ((part_it->second - 40) & 0b111111)];
-                slot.first = true;
-                slot.second += db.lo.revenue[i];
-              }
+            if (c1(dims.s_region[i]) &&
+                c2(dims.p_category[i], dims.p_brand1[i])) {
+              Key::add(acc,
+                       Key::pack(dims.d_year[i], dims.p_brand1[i]),
+                       lo.revenue[i]);
             }
           }
           return acc;
         },
-        agg_merge);
-  });
+        Key::merge);
+  }
 
-  log(query, "Probe", latency);
+  size_t scan_bytes(const LineorderDims &dims) const override {
+    return column_bytes(
+        dims.d_year, dims.s_region, dims.p_category, dims.p_brand1);
+  }
 
-  latency = time([&] { q2_finalize(acc, result); });
+  Bitmap filter(const BitmapIndex &index) const override {
+    return select(index.s_region,
+                  db.s.region,
+                  [&](size_t i) { return c1(db.s.region[i]); }) &
+           select(index.p_brand1, db.p.brand1, [&](size_t i) {
+             return c2(db.p.category[i], db.p.brand1[i]);
+           });
+  }
 
-  log(query, "Finalize", latency);
+  bool rollup(const Cubes &cubes, Accumulator &acc) const override {
+    std::vector<std::vector<int32_t>> values(3);
+    if (!classify(db.d.datekey,
+                  cubes.d_year,
+                  [&](uint32_t key) { return value(hm_date, key); },
+                  values[0]) ||
+        !classify(db.s.suppkey,
+                  cubes.s_region,
+                  [&](uint32_t key) { return member(hs_supplier, key); },
+                  values[1]) ||
+        !classify(db.p.partkey,
+                  cubes.p_brand1,
+                  [&](uint32_t key) {
+                    return value(hm_part[key % n_pt], key);
+                  },
+                  values[2])) {
+      return false;
+    }
 
-  print(result);
+    acc = Key::make();
+    ::rollup(cubes.q2, values, [&](const int32_t *cell, int64_t sum) {
+      Key::add(acc, Key::pack(cell[0], cell[2]), sum);
+    });
+    return true;
+  }
 
-  std::vector<std::tuple<uint32_t, uint16_t, uint16_t>> agg_input;
-  for (size_t i = 0; i < db.lo.orderdate.size(); ++i) {
-    auto &hm_part_pt = hm_part[db.lo.partkey[i] % n_pt];
-    auto part_it = hm_part_pt.find(db.lo.partkey[i]);
-    if (part_it != hm_part_pt.end() && hs_supplier.contains(db.lo.suppkey[i])) {
-      auto date_it = hm_date.find(db.lo.orderdate[i]);
-      if (date_it != hm_date.end()) {
-        agg_input.emplace_back(
-            db.lo.revenue[i], date_it->second, part_it->second);
-      }
-    }
+  void finalize(const Accumulator &acc) override {
+    q2_finalize<Key>(acc, result);
   }
 
-  latency = time([&] {
-    acc = tbb::parallel_reduce(
-        tbb::blocked_range<size_t>(0, agg_input.size()),
-        Accumulator(512),
-        [&agg_input](const tbb::blocked_range<size_t> &r, Accumulator acc) {
-          for (size_t i = r.begin(); i < r.end(); ++i) {
-            auto &[lo_revenue, d_year, p_brand1] = agg_input[i];
-            std::pair<bool, int64_t> &slot =
-                acc[((d_year - 1992) << 6) | ((p_brand1 - 40) & 0b111111)];
-            slot.first = true;
-            slot.second += lo_revenue;
-          }
+  size_t slot(size_t i) const override {
+    return Key::pack(result[i].d_year, result[i].p_brand1);
+  }
+
+private:
+  Accumulator probe_prefetched(const Lineorder &lo) const {
+    return tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, lo.orderdate.size()),
+        Key::make(),
+        [&](const tbb::blocked_range<size_t> &r, Accumulator acc) {
+          uint16_t p_brand1[prefetch_group];
+          uint16_t d_year[prefetch_group];
+          probe_grouped(
+              r.begin(),
+              r.end(),
+              [&](size_t i, size_t j) {
+                Key::add(acc, Key::pack(d_year[j], p_brand1[j]), lo.revenue[i]);
+              },
+              stage(
+                  [&](size_t i) { hs_supplier.prefetch(lo.suppkey[i]); },
+                  [&](size_t i, size_t) {
+                    return hs_supplier.contains(lo.suppkey[i]);
+                  }),
+              stage(
+                  [&](size_t i) {
+                    hm_part[lo.partkey[i] % n_pt].prefetch(lo.partkey[i]);
+                  },
+                  [&](size_t i, size_t j) {
+                    auto &hm = hm_part[lo.partkey[i] % n_pt];
+                    auto it = hm.find(lo.partkey[i]);
+                    if (it == hm.end()) {
+                      return false;
+                    }
+                    p_brand1[j] = it->second;
+                    return true;
+                  }),
+              stage(
+                  [&](size_t i) { hm_date.prefetch(lo.orderdate[i]); },
+                  [&](size_t i, size_t j) {
+                    d_year[j] = hm_date.find(lo.orderdate[i])->second;
+                    return true;
+                  }));
           return acc;
         },
-        agg_merge);
-  });
-
-  log(query, "Agg", latency);
+        Key::merge);
+  }
 
-  q2_finalize(acc, result);
+  const Database &db;
+  C1 c1;
+  C2 c2;
+  hash_set<uint32_t> hs_supplier;
+  std::vector<hash_map<uint32_t, uint16_t>> hm_part;
+  hash_map<uint32_t, uint16_t> hm_date;
+};
 
-  print(result);
+template <typename Key, typename C1, typename C2>
+std::unique_ptr<Query>
+q2(std::string name, const Database &db, C1 c1, C2 c2) {
+  return std::make_unique<Q2<Key, C1, C2>>(std::move(name), db, c1, c2);
 }
 
-void q2p1(const Database &db) {
-  auto c1 = [&](size_t i) { return db.s.region[i] == 2; };
-  auto c2 = [&](size_t i, size_t j) { return db.p_pt[i].category[j] == 2; };
-  q2("Q2.1", db, c1, c2);
+std::unique_ptr<Query> q2p1(const Database &db) {
+  CodeRange america = db.dicts.region.equal("AMERICA");
+  CodeRange mfgr12 = db.dicts.category.equal("MFGR#12");
+  auto c1 = [=](uint8_t region) { return america.contains(region); };
+  auto c2 = [=](uint8_t category, uint16_t brand1) {
+    return mfgr12.contains(category);
+  };
+  using Brand = Dim<uint16_t, 41, 80>;
+  check_domain<Brand>(db.dicts.brand1.prefix("MFGR#12"));
+  using Key = GroupKey<Dim<uint16_t, 1992, 1998>, Brand>;
+  return q2<Key>("Q2.1", db, c1, c2);
 }
 
-void q2p2(const Database &db) {
-  auto c1 = [&](size_t i) { return db.s.region[i] == 3; };
-  auto c2 = [&](size_t i, size_t j) {
-    return db.p_pt[i].brand1[j] >= 254 && db.p_pt[i].brand1[j] <= 261;
+std::unique_ptr<Query> q2p2(const Database &db) {
+  CodeRange asia = db.dicts.region.equal("ASIA");
+  CodeRange brands = db.dicts.brand1.between("MFGR#2221", "MFGR#2228");
+  auto c1 = [=](uint8_t region) { return asia.contains(region); };
+  auto c2 = [=](uint8_t category, uint16_t brand1) {
+    return brands.contains(brand1);
   };
-  q2("Q2.2", db, c1, c2);
+  using Brand = Dim<uint16_t, 254, 261>;
+  check_domain<Brand>(brands);
+  using Key = GroupKey<Dim<uint16_t, 1992, 1998>, Brand>;
+  return q2<Key>("Q2.2", db, c1, c2);
 }
 
-void q2p3(const Database &db) {
-  auto c1 = [&](size_t i) { return db.s.region[i] == 4; };
-  auto c2 = [&](size_t i, size_t j) { return db.p_pt[i].brand1[j] == 254; };
-  q2("Q2.3", db, c1, c2);
+std::unique_ptr<Query> q2p3(const Database &db) {
+  CodeRange europe = db.dicts.region.equal("EUROPE");
+  CodeRange brand = db.dicts.brand1.equal("MFGR#2221");
+  auto c1 = [=](uint8_t region) { return europe.contains(region); };
+  auto c2 = [=](uint8_t category, uint16_t brand1) {
+    return brand.contains(brand1);
+  };
+  using Brand = Dim<uint16_t, 254, 254>;
+  check_domain<Brand>(brand);
+  using Key = GroupKey<Dim<uint16_t, 1992, 1998>, Brand>;
+  return q2<Key>("Q2.3", db, c1, c2);
 }
+
+} // namespace SSB_ISA
@@ -1,7 +1,14 @@
-#include "../common.hpp"
+#include "../bitmap.hpp"
+#include "../cube.hpp"
+#include "../group_key.hpp"
+#include "../pipeline.hpp"
+#include "../prefetch.hpp"
+#include "../query.hpp"
 
 #include "oneapi/tbb.h"
 
+namespace SSB_ISA {
+
 struct Q3P1Row {
   Q3P1Row(uint8_t c_nation,
           uint8_t s_nation,
@@ -52,17 +59,14 @@ struct Q3P234Row {
   uint64_t sum_lo_revenue;
 };
 
-void q3p1_finalize(Accumulator &acc, std::vector<Q3P1Row> &result) {
+using Q3P1Nation = Dim<uint8_t, 1, 25>;
+using Q3P1Key = GroupKey<Q3P1Nation, Q3P1Nation, Dim<uint16_t, 1992, 1997>>;
+
+void q3p1_finalize(const Q3P1Key::accumulator &acc,
+                   std::vector<Q3P1Row> &result) {
   result.clear();
 
-  for (size_t i = 0; i < acc.size(); ++i) {
-    if (acc[i].first) {
-      uint8_t c_nation = i >> 8;
-      uint8_t s_nation = (i >> 3) & 0b11111;
-      uint16_t d_year = (i & 0b111) + 1992;
-      result.emplace_back(c_nation, s_nation, d_year, acc[i].second);
-    }
-  }
+  Q3P1Key::decode(acc, result);
 
   std::sort(
       result.begin(), result.end(), [](const Q3P1Row &a, const Q3P1Row &b) {
@@ -71,135 +75,275 @@ void q3p1_finalize(Accumulator &acc, std::vector<Q3P1Row> &result) {
       });
 }
 
-void q3p1(const Database &db) {
-  double latency;
-  std::vector<Q3P1Row> result;
-
-  std::vector<hash_map<uint32_t, uint8_t>> hm_customer(n_pt);
-  latency = time([&] {
-    tbb::parallel_for(size_t(0), n_pt, [&](size_t i) {
-      const Customer &c_pt = db.c_pt[i];
-      for (size_t j = 0; j < c_pt.custkey.size(); ++j) {
-        if (c_pt.region[j] == 3) {
-          hm_customer[i].emplace(c_pt.custkey[j], c_pt.nation[j]);
+class Q3P1 : public RowQuery<Q3P1Row> {
+public:
+  explicit Q3P1(const Database &db)
+      : RowQuery("Q3.1"), db(db), asia(db.dicts.region.equal("ASIA")),
+        hm_customer(n_pt) {
+    check_domain<Q3P1Nation>(db.dicts.nation.prefix(""));
+  }
+
+  ColumnSet columns() const override {
+    return col::c_custkey | col::c_nation | col::c_region | col::s_suppkey |
+           col::s_nation | col::s_region | col::d_datekey | col::d_year |
+           col::lo_custkey | col::lo_suppkey | col::lo_orderdate |
+           col::lo_revenue;
+  }
+
+  void build() override {
+    double latency;
+
+    latency = time([&] {
+      tbb::parallel_for(size_t(0), n_pt, [&](size_t i) {
+        for (size_t j = db.c_pt.begin(i); j < db.c_pt.end(i); ++j) {
+          if (asia.contains(db.c.region[j])) {
+            hm_customer[i].emplace(db.c.custkey[j], db.c.nation[j]);
+          }
+        }
+      });
+    });
+
+    log(name, "BuildHashMapCustomer", latency);
+
+    latency = time([&] {
+      for (size_t i = 0; i < db.s.suppkey.size(); ++i) {
+        if (asia.contains(db.s.region[i])) {
+          hm_supplier.emplace(db.s.suppkey[i], db.s.nation[i]);
         }
       }
     });
-  });
 
-  log("Q3.1", "BuildHashMapCustomer", latency);
+    log(name, "BuildHashMapSupplier", latency);
 
-  hash_map<uint32_t, uint8_t> hm_supplier;
-  latency = time([&] {
-    for (size_t i = 0; i < db.s.suppkey.size(); ++i) {
-      if (db.s.region[i] == 3) {
-        hm_supplier.emplace(db.s.suppkey[i], db.s.nation[i]);
+    latency = time([&] {
+      for (size_t i = 0; i < db.d.datekey.size(); ++i) {
+        if (db.d.year[i] >= 1992 && db.d.year[i] <= 1997) {
+          hm_date.emplace(db.d.datekey[i], db.d.year[i]);
+        }
       }
+    });
+
+    log(name, "BuildHashMapDate", latency);
+  }
+
+  void log_bytes() const override {
+    log(name, "HashMapCustomerBytes", allocated_bytes(hm_customer));
+    log(name, "HashMapSupplierBytes", allocated_bytes(hm_supplier));
+    log(name, "HashMapDateBytes", allocated_bytes(hm_date));
+    log(name, "AccumulatorBytes", Q3P1Key::bytes);
+  }
+
+  // The probe's joins over lo, in order.
+  auto stages(const Lineorder &lo) const {
+    return pipeline::scan(lo)
+        .join(hm_supplier, lo.suppkey)
+        .join(hm_customer, lo.custkey)
+        .join(hm_date, lo.orderdate);
+  }
+
+  Accumulator probe(const Lineorder &lo) const override {
+    if (prefetch) {
+      return probe_prefetched(lo);
     }
-  });
 
-  log("Q3.1", "BuildHashMapSupplier", latency);
+    return stages(lo).groupby<Q3P1Key, 1, 0, 2>().sum(lo.revenue);
+  }
 
-  hash_map<uint32_t, uint16_t> hm_date;
-  latency = time([&] {
-    for (size_t i = 0; i < db.d.datekey.size(); ++i) {
-      if (db.d.year[i] >= 1992 && db.d.year[i] <= 1997) {
-        hm_date.emplace(db.d.datekey[i], db.d.year[i]);
+  size_t probe_bytes(const Lineorder &lo) const override {
+    return stages(lo).read_bytes(lo.revenue);
+  }
+
+  Accumulator agg(const Lineorder &lo) const override {
+    double latency;
+    Accumulator acc;
+
+    std::vector<std::tuple<uint32_t, uint8_t, uint8_t, uint16_t>> agg_input;
+    for (size_t i = 0; i < lo.orderdate.size(); ++i) {
+      auto supp_it = hm_supplier.find(lo.suppkey[i]);
+      if (supp_it != hm_supplier.end()) {
+        auto &hm_cust_pt = hm_customer[lo.custkey[i] % n_pt];
+        auto cust_it = hm_cust_pt.find(lo.custkey[i]);
+        if (cust_it != hm_cust_pt.end()) {
+          auto date_it = hm_date.find(lo.orderdate[i]);
+          if (date_it != hm_date.end()) {
+            agg_input.emplace_back(lo.revenue[i],
+                                   cust_it->second,
+                                   supp_it->second,
+                                   date_it->second);
+          }
+        }
       }
     }
-  });
 
-  log("Q3.1", "BuildHashMapDate", latency);
+    latency = time([&] {
+      acc = tbb::parallel_reduce(
+          tbb::blocked_range<size_t>(0, agg_input.size()),
+          Q3P1Key::make(),
+          [&agg_input](const tbb::blocked_range<size_t> &r, Accumulator acc) {
+            for (size_t i = r.begin(); i < r.end(); ++i) {
+              auto &[lo_revenue, c_nation, s_nation, d_year] = agg_input[i];
+              Q3P1Key::add(
+                  acc, Q3P1Key::pack(c_nation, s_nation, d_year), lo_revenue);
+            }
+            return acc;
+          },
+          Q3P1Key::merge);
+    });
+
+    log(name, "Agg", latency);
+    log(name, "AggInputBytes", allocated_bytes(agg_input));
+    log_bandwidth(name, "Agg", column_bytes(agg_input), latency);
 
-  Accumulator acc;
-  latency = time([&] {
-    acc = tbb::parallel_reduce(
-        tbb::blocked_range<size_t>(0, db.lo.orderdate.size()),
-        Accumulator(8192),
+    return acc;
+  }
+
+  Accumulator scan(const Lineorder &lo,
+                   const LineorderDims &dims) const override {
+    return tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, lo.orderdate.size()),
+        Q3P1Key::make(),
         [&](const tbb::blocked_range<size_t> &r, Accumulator acc) {
           for (size_t i = r.begin(); i < r.end(); ++i) {
-            auto supp_it = hm_supplier.find(db.lo.suppkey[i]);
-            if (supp_it != hm_supplier.end()) {
-              auto &hm_cust_pt = hm_customer[db.lo.custkey[i] % n_pt];
-              auto cust_it = hm_cust_pt.find(db.lo.custkey[i]);
-              if (cust_it != hm_cust_pt.end()) {
-                auto date_it = hm_date.find(db.lo.orderdate[i]);
-                if (date_it != hm_date.end()) {
-                  std::pair<bool, int64_t> &slot =
-                      acc[(cust_it->second << 8) | (supp_it->second << 3) |
-                          (date_it->second - 1992)];
-                  slot.first = true;
-                  slot.second += db.lo.revenue[i];
-                }
-              }
+            if (asia.contains(dims.s_region[i]) &&
+                asia.contains(dims.c_region[i]) &&
+                dims.d_year[i] >= 1992 && dims.d_year[i] <= 1997) {
+              Q3P1Key::add(acc,
+                           Q3P1Key::pack(dims.c_nation[i],
+                                         dims.s_nation[i],
+                                         dims.d_year[i]),
+                           lo.revenue[i]);
             }
           }
           return acc;
         },
-        agg_merge);
-  });
-
-  log("Q3.1", "Probe", latency);
-
-  latency = time([&] { q3p1_finalize(acc, result); });
-
-  log("Q3.1", "Finalize", latency);
-
-  print(result);
-
-  std::vector<std::tuple<uint32_t, uint8_t, uint8_t, uint16_t>> agg_input;
-  for (size_t i = 0; i < db.lo.orderdate.size(); ++i) {
-    auto supp_it = hm_supplier.find(db.lo.suppkey[i]);
-    if (supp_it != hm_supplier.end()) {
-      auto &hm_cust_pt = hm_customer[db.lo.custkey[i] % n_pt];
-      auto cust_it = hm_cust_pt.find(db.lo.custkey[i]);
-      if (cust_it != hm_cust_pt.end()) {
-        auto date_it = hm_date.find(db.lo.orderdate[i]);
-        if (date_it != hm_date.end()) {
-          agg_input.emplace_back(db.lo.revenue[i],
-                                 cust_it->second,
-                                 supp_it->second,
-                                 date_it->second);
-        }
-      }
+        Q3P1Key::merge);
+  }
+
+  size_t scan_bytes(const LineorderDims &dims) const override {
+    return column_bytes(dims.d_year,
+                        dims.c_nation,
+                        dims.c_region,
+                        dims.s_nation,
+                        dims.s_region);
+  }
+
+  Bitmap filter(const BitmapIndex &index) const override {
+    auto region = [&](uint32_t region) { return asia.contains(region); };
+    return select(index.c_region, region) & select(index.s_region, region) &
+           select(index.d_year, [](uint32_t year) {
+             return year >= 1992 && year <= 1997;
+           });
+  }
+
+  bool rollup(const Cubes &cubes, Accumulator &acc) const override {
+    std::vector<std::vector<int32_t>> values(3);
+    if (!classify(db.d.datekey,
+                  cubes.d_yearmonth,
+                  [&](uint32_t key) { return value(hm_date, key); },
+                  values[0]) ||
+        !classify(db.c.custkey,
+                  cubes.c_city,
+                  [&](uint32_t key) {
+                    return value(hm_customer[key % n_pt], key);
+                  },
+                  values[1]) ||
+        !classify(db.s.suppkey,
+                  cubes.s_city,
+                  [&](uint32_t key) { return value(hm_supplier, key); },
+                  values[2])) {
+      return false;
     }
+
+    acc = Q3P1Key::make();
+    ::rollup(cubes.q3, values, [&](const int32_t *cell, int64_t sum) {
+      Q3P1Key::add(acc, Q3P1Key::pack(cell[1], cell[2], cell[0]), sum);
+    });
+    return true;
   }
 
-  latency = time([&] {
-    acc = tbb::parallel_reduce(
-        tbb::blocked_range<size_t>(0, agg_input.size()),
-        Accumulator(8192),
-        [&agg_input](const tbb::blocked_range<size_t> &r, Accumulator acc) {
-          for (size_t i = r.begin(); i < r.end(); ++i) {
-            auto &[lo_revenue, c_nation, s_nation, d_year] = agg_input[i];
-            std::pair<bool, int64_t> &slot =
-                acc[(c_nation << 8) | (s_nation << 3) | (d_year - 1992)];
-            slot.first = true;
-            slot.second += lo_revenue;
-          }
+  void finalize(const Accumulator &acc) override {
+    q3p1_finalize(acc, result);
+  }
+
+  size_t slot(size_t i) const override {
+    const Q3P1Row &row = result[i];
+    return Q3P1Key::pack(row.c_nation, row.s_nation, row.d_year);
+  }
+
+private:
+  Accumulator probe_prefetched(const Lineorder &lo) const {
+    return tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, lo.orderdate.size()),
+        Q3P1Key::make(),
+        [&](const tbb::blocked_range<size_t> &r, Accumulator acc) {
+          uint8_t s_nation[prefetch_group];
+          uint8_t c_nation[prefetch_group];
+          uint16_t d_year[prefetch_group];
+          probe_grouped(
+              r.begin(),
+              r.end(),
+              [&](size_t i, size_t j) {
+                Q3P1Key::add(acc,
+                             Q3P1Key::pack(c_nation[j], s_nation[j], d_year[j]),
+                             lo.revenue[i]);
+              },
+              stage(
+                  [&](size_t i) { hm_supplier.prefetch(lo.suppkey[i]); },
+                  [&](size_t i, size_t j) {
+                    auto &hm = hm_supplier;
+                    auto it = hm.find(lo.suppkey[i]);
+                    if (it == hm.end()) {
+                      return false;
+                    }
+                    s_nation[j] = it->second;
+                    return true;
+                  }),
+              stage(
+                  [&](size_t i) {
+                    hm_customer[lo.custkey[i] % n_pt].prefetch(lo.custkey[i]);
+                  },
+                  [&](size_t i, size_t j) {
+                    auto &hm = hm_customer[lo.custkey[i] % n_pt];
+                    auto it = hm.find(lo.custkey[i]);
+                    if (it == hm.end()) {
+                      return false;
+                    }
+                    c_nation[j] = it->second;
+                    return true;
+                  }),
+              stage(
+                  [&](size_t i) { hm_date.prefetch(lo.orderdate[i]); },
+                  [&](size_t i, size_t j) {
+                    auto &hm = hm_date;
+                    auto it = hm.find(lo.orderdate[i]);
+                    if (it == hm.end()) {
+                      return false;
+                    }
+                    d_year[j] = it->second;
+                    return true;
+                  }));
           return acc;
         },
-        agg_merge);
-  });
-
-  log("Q3.1", "Agg", latency);
+        Q3P1Key::merge);
+  }
 
-  q3p1_finalize(acc, result);
+  const Database &db;
+  CodeRange asia;
+  std::vector<hash_map<uint32_t, uint8_t>> hm_customer;
+  hash_map<uint32_t, uint8_t> hm_supplier;
+  hash_map<uint32_t, uint16_t> hm_date;
+};
 
-  print(result);
+std::unique_ptr<Query> q3p1(const Database &db) {
+  return std::make_unique<Q3P1>(db);
 }
 
-void q3p234_finalize(Accumulator &acc, std::vector<Q3P234Row> &result) {
+template <typename Key>
+void q3p234_finalize(const typename Key::accumulator &acc,
+                     std::vector<Q3P234Row> &result) {
   result.clear();
 
-  for (size_t i = 0; i < acc.size(); ++i) {
-    if (acc[i].first) {
-      uint8_t c_city = (i >> 8) + 221;
-      uint8_t s_city = ((i >> 3) & 0b11111) + 221;
-      uint16_t d_year = (i & 0b111) + 1992;
-      result.emplace_back(c_city, s_city, d_year, acc[i].second);
-    }
-  }
+  Key::decode(acc, result);
 
   std::sort(
       result.begin(), result.end(), [](const Q3P234Row &a, const Q3P234Row &b) {
@@ -208,157 +352,324 @@ void q3p234_finalize(Accumulator &acc, std::vector<Q3P234Row> &result) {
       });
 }
 
-template <typename C1, typename C2, typename C3>
-void q3p234(
-    const std::string &query, const Database &db, C1 &&c1, C2 &&c2, C3 &&c3) {
-  double latency;
-  std::vector<Q3P234Row> result;
-
-  std::vector<hash_map<uint32_t, uint8_t>> hm_customer(n_pt);
-  latency = time([&] {
-    tbb::parallel_for(size_t(0), n_pt, [&](size_t i) {
-      const Customer &c_pt = db.c_pt[i];
-      for (size_t j = 0; j < c_pt.custkey.size(); ++j) {
-        if (c1(i, j)) {
-          hm_customer[i].emplace(c_pt.custkey[j], c_pt.city[j]);
+template <typename Key, typename C1, typename C2, typename C3>
+class Q3P234 : public RowQuery<Q3P234Row> {
+  static_assert(Key::dense);
+
+public:
+  Q3P234(std::string name, const Database &db, C1 c1, C2 c2, C3 c3)
+      : RowQuery(std::move(name)), db(db), c1(c1), c2(c2), c3(c3),
+        hm_customer(n_pt) {}
+
+  ColumnSet columns() const override {
+    return col::c_custkey | col::c_city | col::c_nation | col::s_suppkey |
+           col::s_city | col::s_nation | col::d_datekey | col::d_year |
+           col::d_yearmonth | col::lo_custkey | col::lo_suppkey |
+           col::lo_orderdate | col::lo_revenue;
+  }
+
+  void build() override {
+    double latency;
+
+    latency = time([&] {
+      tbb::parallel_for(size_t(0), n_pt, [&](size_t i) {
+        for (size_t j = db.c_pt.begin(i); j < db.c_pt.end(i); ++j) {
+          if (c1(db.c.nation[j], db.c.city[j])) {
+            hm_customer[i].emplace(db.c.custkey[j], db.c.city[j]);
+          }
+        }
+      });
+    });
+
+    log(name, "BuildHashMapCustomer", latency);
+
+    latency = time([&] {
+      for (size_t i = 0; i < db.s.suppkey.size(); ++i) {
+        if (c2(db.s.nation[i], db.s.city[i])) {
+          hm_supplier.emplace(db.s.suppkey[i], db.s.city[i]);
         }
       }
     });
-  });
 
-  log(query, "BuildHashMapCustomer", latency);
+    log(name, "BuildHashMapSupplier", latency);
 
-  hash_map<uint32_t, uint8_t> hm_supplier;
-  latency = time([&] {
-    for (size_t i = 0; i < db.s.suppkey.size(); ++i) {
-      if (c2(i)) {
-        hm_supplier.emplace(db.s.suppkey[i], db.s.city[i]);
+    latency = time([&] {
+      for (size_t i = 0; i < db.d.datekey.size(); ++i) {
+        if (c3(db.d.year[i], db.d.yearmonth[i])) {
+          hm_date.emplace(db.d.datekey[i], db.d.year[i]);
+        }
       }
+    });
+
+    log(name, "BuildHashMapDate", latency);
+  }
+
+  void log_bytes() const override {
+    log(name, "HashMapCustomerBytes", allocated_bytes(hm_customer));
+    log(name, "HashMapSupplierBytes", allocated_bytes(hm_supplier));
+    log(name, "HashMapDateBytes", allocated_bytes(hm_date));
+    log(name, "AccumulatorBytes", Key::bytes);
+  }
+
+  // The probe's joins over lo, in order.
+  auto stages(const Lineorder &lo) const {
+    return pipeline::scan(lo)
+        .join(hm_supplier, lo.suppkey)
+        .join(hm_customer, lo.custkey)
+        .join(hm_date, lo.orderdate);
+  }
+
+  Accumulator probe(const Lineorder &lo) const override {
+    if (prefetch) {
+      return probe_prefetched(lo);
     }
-  });
 
-  log(query, "BuildHashMapSupplier", latency);
+    return stages(lo).template groupby<Key, 1, 0, 2>().sum(lo.revenue);
+  }
 
-  hash_map<uint32_t, uint16_t> hm_date;
-  latency = time([&] {
-    for (size_t i = 0; i < db.d.datekey.size(); ++i) {
-      if (c3(i)) {
-        hm_date.emplace(db.d.datekey[i], db.d.year[i]);
+  size_t probe_bytes(const Lineorder &lo) const override {
+    return stages(lo).read_bytes(lo.revenue);
+  }
+
+  Accumulator agg(const Lineorder &lo) const override {
+    double latency;
+    Accumulator acc;
+
+    std::vector<std::tuple<uint32_t, uint8_t, uint8_t, uint16_t>> agg_input;
+    for (size_t i = 0; i < lo.orderdate.size(); ++i) {
+      auto supp_it = hm_supplier.find(lo.suppkey[i]);
+      if (supp_it != hm_supplier.end()) {
+        auto &hm_cust_pt = hm_customer[lo.custkey[i] % n_pt];
+        auto cust_it = hm_cust_pt.find(lo.custkey[i]);
+        if (cust_it != hm_cust_pt.end()) {
+          auto date_it = hm_date.find(lo.orderdate[i]);
+          if (date_it != hm_date.end()) {
+            agg_input.emplace_back(lo.revenue[i],
+                                   cust_it->second,
+                                   supp_it->second,
+                                   date_it->second);
+          }
+        }
       }
     }
-  });
 
-  log(query, "BuildHashMapDate", latency);
+    latency = time([&] {
+      acc = tbb::parallel_reduce(
+          tbb::blocked_range<size_t>(0, agg_input.size()),
+          Key::make(),
+          [&agg_input](const tbb::blocked_range<size_t> &r, Accumulator acc) {
+            for (size_t i = r.begin(); i < r.end(); ++i) {
+              auto &[lo_revenue, c_city, s_city, d_year] = agg_input[i];
+              Key::add(acc, Key::pack(c_city, s_city, d_year), lo_revenue);
+            }
+            return acc;
+          },
+          Key::merge);
+    });
+
+    log(name, "Agg", latency);
+    log(name, "AggInputBytes", allocated_bytes(agg_input));
+    log_bandwidth(name, "Agg", column_bytes(agg_input), latency);
+
+    return acc;
+  }
 
-  Accumulator acc;
-  latency = time([&] {
-    acc = tbb::parallel_reduce(
-        tbb::blocked_range<size_t>(0, db.lo.orderdate.size()),
-        Accumulator(8192),
+  Accumulator scan(const Lineorder &lo,
+                   const LineorderDims &dims) const override {
+    return tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, lo.orderdate.size()),
+        Key::make(),
         [&](const tbb::blocked_range<size_t> &r, Accumulator acc) {
           for (size_t i = r.begin(); i < r.end(); ++i) {
-            auto supp_it = hm_supplier.find(db.lo.suppkey[i]);
-            if (supp_it != hm_supplier.end()) {
-              auto &hm_cust_pt = hm_customer[db.lo.custkey[i] % n_pt];
-              auto cust_it = hm_cust_pt.find(db.lo.custkey[i]);
-              if (cust_it != hm_cust_pt.end()) {
-                auto date_it = hm_date.find(db.lo.orderdate[i]);
-                if (date_it != hm_date.end()) {
-                  std::pair<bool, int64_t> &slot =
-                      acc[((cust_it->second - 221) << 8) |
-                          ((supp_it->second - 221) << 3) |
-                          (date_it->second - 1992)];
-                  slot.first = true;
-                  slot.second += db.lo.revenue[i];
-                }
-              }
+            if (c2(dims.s_nation[i], dims.s_city[i]) &&
+                c1(dims.c_nation[i], dims.c_city[i]) &&
+                c3(dims.d_year[i], dims.d_yearmonth[i])) {
+              Key::add(
+                  acc,
+                  Key::pack(dims.c_city[i], dims.s_city[i], dims.d_year[i]),
+                  lo.revenue[i]);
             }
           }
           return acc;
         },
-        agg_merge);
-  });
-
-  log(query, "Probe", latency);
-
-  latency = time([&] { q3p234_finalize(acc, result); });
-
-  log(query, "Finalize", latency);
-
-  print(result);
-
-  std::vector<std::tuple<uint32_t, uint8_t, uint8_t, uint16_t>> agg_input;
-  for (size_t i = 0; i < db.lo.orderdate.size(); ++i) {
-    auto supp_it = hm_supplier.find(db.lo.suppkey[i]);
-    if (supp_it != hm_supplier.end()) {
-      auto &hm_cust_pt = hm_customer[db.lo.custkey[i] % n_pt];
-      auto cust_it = hm_cust_pt.find(db.lo.custkey[i]);
-      if (cust_it != hm_cust_pt.end()) {
-        auto date_it = hm_date.find(db.lo.orderdate[i]);
-        if (date_it != hm_date.end()) {
-          agg_input.emplace_back(db.lo.revenue[i],
-                                 cust_it->second,
-                                 supp_it->second,
-                                 date_it->second);
-        }
-      }
+        Key::merge);
+  }
+
+  size_t scan_bytes(const LineorderDims &dims) const override {
+    return column_bytes(dims.d_year,
+                        dims.d_yearmonth,
+                        dims.c_city,
+                        dims.c_nation,
+                        dims.s_city,
+                        dims.s_nation);
+  }
+
+  Bitmap filter(const BitmapIndex &index) const override {
+    return select(index.c_city,
+                  db.c.city,
+                  [&](size_t i) { return c1(db.c.nation[i], db.c.city[i]); }) &
+           select(index.s_city,
+                  db.s.city,
+                  [&](size_t i) { return c2(db.s.nation[i], db.s.city[i]); }) &
+           select(index.d_yearmonth, db.d.yearmonth, [&](size_t i) {
+             return c3(db.d.year[i], db.d.yearmonth[i]);
+           });
+  }
+
+  bool rollup(const Cubes &cubes, Accumulator &acc) const override {
+    std::vector<std::vector<int32_t>> values(3);
+    if (!classify(db.d.datekey,
+                  cubes.d_yearmonth,
+                  [&](uint32_t key) { return value(hm_date, key); },
+                  values[0]) ||
+        !classify(db.c.custkey,
+                  cubes.c_city,
+                  [&](uint32_t key) {
+                    return value(hm_customer[key % n_pt], key);
+                  },
+                  values[1]) ||
+        !classify(db.s.suppkey,
+                  cubes.s_city,
+                  [&](uint32_t key) { return value(hm_supplier, key); },
+                  values[2])) {
+      return false;
     }
+
+    acc = Key::make();
+    ::rollup(cubes.q3, values, [&](const int32_t *cell, int64_t sum) {
+      Key::add(acc, Key::pack(cell[1], cell[2], cell[0]), sum);
+    });
+    return true;
   }
 
-  latency = time([&] {
-    acc = tbb::parallel_reduce(
-        tbb::blocked_range<size_t>(0, agg_input.size()),
-        Accumulator(8192),
-        [&agg_input](const tbb::blocked_range<size_t> &r, Accumulator acc) {
-          for (size_t i = r.begin(); i < r.end(); ++i) {
-            auto &[lo_revenue, c_city, s_city, d_year] = agg_input[i];
-            std::pair<bool, int64_t> &slot =
-                acc[((c_city - 221) << 8) | ((s_city - 221) << 3) |
-                    (d_year - 1992)];
-            slot.first = true;
-            slot.second += lo_revenue;
-          }
+  void finalize(const Accumulator &acc) override {
+    q3p234_finalize<Key>(acc, result);
+  }
+
+  size_t slot(size_t i) const override {
+    const Q3P234Row &row = result[i];
+    return Key::pack(row.c_city, row.s_city, row.d_year);
+  }
+
+private:
+  Accumulator probe_prefetched(const Lineorder &lo) const {
+    return tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, lo.orderdate.size()),
+        Key::make(),
+        [&](const tbb::blocked_range<size_t> &r, Accumulator acc) {
+          uint8_t s_city[prefetch_group];
+          uint8_t c_city[prefetch_group];
+          uint16_t d_year[prefetch_group];
+          probe_grouped(
+              r.begin(),
+              r.end(),
+              [&](size_t i, size_t j) {
+                Key::add(acc,
+                         Key::pack(c_city[j], s_city[j], d_year[j]),
+                         lo.revenue[i]);
+              },
+              stage(
+                  [&](size_t i) { hm_supplier.prefetch(lo.suppkey[i]); },
+                  [&](size_t i, size_t j) {
+                    auto &hm = hm_supplier;
+                    auto it = hm.find(lo.suppkey[i]);
+                    if (it == hm.end()) {
+                      return false;
+                    }
+                    s_city[j] = it->second;
+                    return true;
+                  }),
+              stage(
+                  [&](size_t i) {
+                    hm_customer[lo.custkey[i] % n_pt].prefetch(lo.custkey[i]);
+                  },
+                  [&](size_t i, size_t j) {
+                    auto &hm = hm_customer[lo.custkey[i] % n_pt];
+                    auto it = hm.find(lo.custkey[i]);
+                    if (it == hm.end()) {
+                      return false;
+                    }
+                    c_city[j] = it->second;
+                    return true;
+                  }),
+              stage(
+                  [&](size_t i) { hm_date.prefetch(lo.orderdate[i]); },
+                  [&](size_t i, size_t j) {
+                    auto &hm = hm_date;
+                    auto it = hm.find(lo.orderdate[i]);
+                    if (it == hm.end()) {
+                      return false;
+                    }
+                    d_year[j] = it->second;
+                    return true;
+                  }));
           return acc;
         },
-        agg_merge);
-  });
-
-  log(query, "Agg", latency);
+        Key::merge);
+  }
 
-  q3p234_finalize(acc, result);
+  const Database &db;
+  C1 c1;
+  C2 c2;
+  C3 c3;
+  std::vector<hash_map<uint32_t, uint8_t>> hm_customer;
+  hash_map<uint32_t, uint8_t> hm_supplier;
+  hash_map<uint32_t, uint16_t> hm_date;
+};
 
-  print(result);
+template <typename Key, typename C1, typename C2, typename C3>
+std::unique_ptr<Query>
+q3p234(std::string name, const Database &db, C1 c1, C2 c2, C3 c3) {
+  return std::make_unique<Q3P234<Key, C1, C2, C3>>(
+      std::move(name), db, c1, c2, c3);
 }
 
-void q3p2(const Database &db) {
-  auto c1 = [&](size_t i, size_t j) { return db.c_pt[i].nation[j] == 24; };
-  auto c2 = [&](size_t i) { return db.s.nation[i] == 24; };
-  auto c3 = [&](size_t i) {
-    return db.d.year[i] >= 1992 && db.d.year[i] <= 1997;
+std::unique_ptr<Query> q3p2(const Database &db) {
+  CodeRange united_states = db.dicts.nation.equal("UNITED STATES");
+  auto c1 = [=](uint8_t nation, uint8_t city) {
+    return united_states.contains(nation);
   };
-  q3p234("Q3.2", db, c1, c2, c3);
+  auto c2 = c1;
+  auto c3 = [](uint16_t year, uint32_t yearmonth) {
+    return year >= 1992 && year <= 1997;
+  };
+  using City = Dim<uint8_t, 231, 240>;
+  check_domain<City>(db.dicts.city.prefix("UNITED ST"));
+  using Key = GroupKey<City, City, Dim<uint16_t, 1992, 1997>>;
+  return q3p234<Key>("Q3.2", db, c1, c2, c3);
 }
 
-void q3p3(const Database &db) {
-  auto c1 = [&](size_t i, size_t j) {
-    return db.c_pt[i].city[j] == 222 || db.c_pt[i].city[j] == 226;
-  };
-  auto c2 = [&](size_t i) {
-    return db.s.city[i] == 222 || db.s.city[i] == 226;
+std::unique_ptr<Query> q3p3(const Database &db) {
+  CodeRange ki1 = db.dicts.city.equal("UNITED KI1");
+  CodeRange ki5 = db.dicts.city.equal("UNITED KI5");
+  auto c1 = [=](uint8_t nation, uint8_t city) {
+    return ki1.contains(city) || ki5.contains(city);
   };
-  auto c3 = [&](size_t i) {
-    return db.d.year[i] >= 1992 && db.d.year[i] <= 1997;
+  auto c2 = c1;
+  auto c3 = [](uint16_t year, uint32_t yearmonth) {
+    return year >= 1992 && year <= 1997;
   };
-  q3p234("Q3.3", db, c1, c2, c3);
+  using City = Dim<uint8_t, 222, 226>;
+  check_domain<City>(db.dicts.city.between("UNITED KI1", "UNITED KI5"));
+  using Key = GroupKey<City, City, Dim<uint16_t, 1992, 1997>>;
+  return q3p234<Key>("Q3.3", db, c1, c2, c3);
 }
 
-void q3p4(const Database &db) {
-  auto c1 = [&](size_t i, size_t j) {
-    return db.c_pt[i].city[j] == 222 || db.c_pt[i].city[j] == 226;
+std::unique_ptr<Query> q3p4(const Database &db) {
+  CodeRange ki1 = db.dicts.city.equal("UNITED KI1");
+  CodeRange ki5 = db.dicts.city.equal("UNITED KI5");
+  CodeRange dec1997 = db.dicts.yearmonth.equal("Dec1997");
+  auto c1 = [=](uint8_t nation, uint8_t city) {
+    return ki1.contains(city) || ki5.contains(city);
   };
-  auto c2 = [&](size_t i) {
-    return db.s.city[i] == 222 || db.s.city[i] == 226;
+  auto c2 = c1;
+  auto c3 = [=](uint16_t year, uint32_t yearmonth) {
+    return dec1997.contains(yearmonth);
   };
-  auto c3 = [&](size_t i) { return db.d.yearmonth[i] == 20; };
-  q3p234("Q3.4", db, c1, c2, c3);
+  using City = Dim<uint8_t, 222, 226>;
+  check_domain<City>(db.dicts.city.between("UNITED KI1", "UNITED KI5"));
+  using Key = GroupKey<City, City, Dim<uint16_t, 1992, 1998>>;
+  return q3p234<Key>("Q3.4", db, c1, c2, c3);
 }
+
+} // namespace SSB_ISA
@@ -1,7 +1,14 @@
-#include "../common.hpp"
+#include "../bitmap.hpp"
+#include "../cube.hpp"
+#include "../group_key.hpp"
+#include "../pipeline.hpp"
+#include "../prefetch.hpp"
+#include "../query.hpp"
 
 #include "oneapi/tbb.h"
 
+namespace SSB_ISA {
+
 struct Q4P1Row {
   Q4P1Row(uint16_t d_year, uint8_t c_nation, int64_t sum_profit)
       : d_year(d_year), c_nation(c_nation), sum_profit(sum_profit) {}
@@ -71,16 +78,14 @@ struct Q4P3Row {
   int64_t sum_profit;
 };
 
-void q4p1_finalize(Accumulator &acc, std::vector<Q4P1Row> &result) {
+using Q4P1Nation = Dim<uint8_t, 1, 25>;
+using Q4P1Key = GroupKey<Dim<uint16_t, 1992, 1998>, Q4P1Nation>;
+
+void q4p1_finalize(const Q4P1Key::accumulator &acc,
+                   std::vector<Q4P1Row> &result) {
   result.clear();
   result.reserve(acc.size());
-  for (size_t i = 0; i < acc.size(); ++i) {
-    if (acc[i].first) {
-      uint16_t d_year = (i >> 5) + 1992;
-      uint8_t c_nation = i & 0b11111;
-      result.emplace_back(d_year, c_nation, acc[i].second);
-    }
-  }
+  Q4P1Key::decode(acc, result);
   std::sort(
       result.begin(), result.end(), [](const Q4P1Row &a, const Q4P1Row &b) {
         return a.d_year < b.d_year ||
@@ -88,145 +93,293 @@ void q4p1_finalize(Accumulator &acc, std::vector<Q4P1Row> &result) {
       });
 }
 
-void q4p1(const Database &db) {
-  double latency;
-  std::vector<Q4P1Row> result;
+class Q4P1 : public RowQuery<Q4P1Row> {
+public:
+  explicit Q4P1(const Database &db)
+      : RowQuery("Q4.1"), db(db), america(db.dicts.region.equal("AMERICA")),
+        mfgr1_2(db.dicts.mfgr.between("MFGR#1", "MFGR#2")), hm_customer(n_pt),
+        hs_part(n_pt) {
+    check_domain<Q4P1Nation>(db.dicts.nation.prefix(""));
+  }
 
-  hash_map<uint32_t, uint16_t> hm_date;
-  latency = time([&] {
-    for (size_t i = 0; i < db.d.datekey.size(); ++i) {
-      hm_date.emplace(db.d.datekey[i], db.d.year[i]);
-    }
-  });
+  ColumnSet columns() const override {
+    return col::d_datekey | col::d_year | col::c_custkey | col::c_nation |
+           col::c_region | col::s_suppkey | col::s_region | col::p_partkey |
+           col::p_mfgr | col::lo_custkey | col::lo_partkey | col::lo_suppkey |
+           col::lo_orderdate | col::lo_revenue | col::lo_supplycost;
+  }
 
-  log("Q4.1", "BuildHashMapDate", latency);
+  void build() override {
+    double latency;
 
-  std::vector<hash_map<uint32_t, uint8_t>> hm_customer(n_pt);
-  latency = time([&] {
-    tbb::parallel_for(size_t(0), n_pt, [&](size_t i) {
-      const Customer &c_pt = db.c_pt[i];
-      for (size_t j = 0; j < c_pt.custkey.size(); ++j) {
-        if (c_pt.region[j] == 2) {
-          hm_customer[i].emplace(c_pt.custkey[j], c_pt.nation[j]);
-        }
+    latency = time([&] {
+      for (size_t i = 0; i < db.d.datekey.size(); ++i) {
+        hm_date.emplace(db.d.datekey[i], db.d.year[i]);
       }
     });
-  });
 
-  log("Q4.1", "BuildHashMapCustomer", latency);
+    log(name, "BuildHashMapDate", latency);
 
-  hash_set<uint32_t> hs_supplier;
-  latency = time([&] {
-    for (size_t i = 0; i < db.s.suppkey.size(); ++i) {
-      if (db.s.region[i] == 2) {
-        hs_supplier.emplace(db.s.suppkey[i]);
+    latency = time([&] {
+      tbb::parallel_for(size_t(0), n_pt, [&](size_t i) {
+        for (size_t j = db.c_pt.begin(i); j < db.c_pt.end(i); ++j) {
+          if (america.contains(db.c.region[j])) {
+            hm_customer[i].emplace(db.c.custkey[j], db.c.nation[j]);
+          }
+        }
+      });
+    });
+
+    log(name, "BuildHashMapCustomer", latency);
+
+    latency = time([&] {
+      for (size_t i = 0; i < db.s.suppkey.size(); ++i) {
+        if (america.contains(db.s.region[i])) {
+          hs_supplier.emplace(db.s.suppkey[i]);
+        }
       }
+    });
+
+    log(name, "BuildHashSetSupplier", latency);
+
+    latency = time([&] {
+      tbb::parallel_for(size_t(0), n_pt, [&](size_t i) {
+        hs_part[i].reserve(db.p_pt.size(i));
+        for (size_t j = db.p_pt.begin(i); j < db.p_pt.end(i); ++j) {
+          if (mfgr1_2.contains(db.p.mfgr[j])) {
+            hs_part[i].emplace(db.p.partkey[j]);
+          }
+        }
+      });
+    });
+
+    log(name, "BuildHashSetPart", latency);
+  }
+
+  void log_bytes() const override {
+    log(name, "HashMapDateBytes", allocated_bytes(hm_date));
+    log(name, "HashMapCustomerBytes", allocated_bytes(hm_customer));
+    log(name, "HashSetSupplierBytes", allocated_bytes(hs_supplier));
+    log(name, "HashSetPartBytes", allocated_bytes(hs_part));
+    log(name, "AccumulatorBytes", Q4P1Key::bytes);
+  }
+
+  // The probe's joins over lo, in order.
+  auto stages(const Lineorder &lo) const {
+    return pipeline::scan(lo)
+        .semijoin(hs_supplier, lo.suppkey)
+        .semijoin(hs_part, lo.partkey)
+        .join(hm_customer, lo.custkey)
+        .join(hm_date, lo.orderdate);
+  }
+
+  Accumulator probe(const Lineorder &lo) const override {
+    if (prefetch) {
+      return probe_prefetched(lo);
     }
-  });
-
-  log("Q4.1", "BuildHashSetSupplier", latency);
-
-  std::vector<hash_set<uint32_t>> hs_part(n_pt);
-  latency = time([&] {
-    tbb::parallel_for(size_t(0), n_pt, [&](size_t i) {
-      const Part &p_pt = db.p_pt[i];
-      hs_part[i].reserve(p_pt.partkey.size());
-      for (size_t j = 0; j < p_pt.partkey.size(); ++j) {
-        if (p_pt.mfgr[j] == 1 || p_pt.mfgr[j] == 2) {
-          hs_part[i].emplace(p_pt.partkey[j]);
+
+    return stages(lo).groupby<Q4P1Key, 1, 0>().sum(
+        [&](size_t i) { return lo.revenue[i] - lo.supplycost[i]; });
+  }
+
+  size_t probe_bytes(const Lineorder &lo) const override {
+    return stages(lo).read_bytes(lo.revenue, lo.supplycost);
+  }
+
+  Accumulator agg(const Lineorder &lo) const override {
+    double latency;
+    Accumulator acc;
+
+    std::vector<std::tuple<uint32_t, uint32_t, uint16_t, uint8_t>> agg_input;
+    for (size_t i = 0; i < lo.orderdate.size(); ++i) {
+      if (hs_supplier.contains(lo.suppkey[i])) {
+        auto &hs_part_pt = hs_part[lo.partkey[i] % n_pt];
+        if (hs_part_pt.contains(lo.partkey[i])) {
+          auto &hm_cust_pt = hm_customer[lo.custkey[i] % n_pt];
+          auto cust_it = hm_cust_pt.find(lo.custkey[i]);
+          if (cust_it != hm_cust_pt.end()) {
+            uint16_t d_year = hm_date.find(lo.orderdate[i])->second;
+            agg_input.emplace_back(
+                lo.revenue[i], lo.supplycost[i], d_year, cust_it->second);
+          }
         }
       }
+    }
+
+    latency = time([&] {
+      acc = tbb::parallel_reduce(
+          tbb::blocked_range<size_t>(0, agg_input.size()),
+          Q4P1Key::make(),
+          [&](const tbb::blocked_range<size_t> &r, Accumulator acc) {
+            for (size_t i = r.begin(); i < r.end(); ++i) {
+              auto &[lo_revenue, lo_supplycost, d_year, c_nation] =
+                  agg_input[i];
+              Q4P1Key::add(acc,
+                           Q4P1Key::pack(d_year, c_nation),
+                           lo_revenue - lo_supplycost);
+            }
+            return acc;
+          },
+          Q4P1Key::merge);
     });
-  });
 
-  log("Q4.1", "BuildHashSetPart", latency);
+    log(name, "Agg", latency);
+    log(name, "AggInputBytes", allocated_bytes(agg_input));
+    log_bandwidth(name, "Agg", column_bytes(agg_input), latency);
+
+    return acc;
+  }
 
-  Accumulator acc;
-  latency = time([&] {
-    acc = tbb::parallel_reduce(
-        tbb::blocked_range<size_t>(0, db.lo.orderdate.size()),
-        Accumulator(256),
+  Accumulator scan(const Lineorder &lo,
+                   const LineorderDims &dims) const override {
+    return tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, lo.orderdate.size()),
+        Q4P1Key::make(),
         [&](const tbb::blocked_range<size_t> &r, Accumulator acc) {
           for (size_t i = r.begin(); i < r.end(); ++i) {
-            if (hs_supplier.contains(db.lo.suppkey[i])) {
-              auto &hs_part_pt = hs_part[db.lo.partkey[i] % n_pt];
-              if (hs_part_pt.contains(db.lo.partkey[i])) {
-                auto &hm_cust_pt = hm_customer[db.lo.custkey[i] % n_pt];
-                auto cust_it = hm_cust_pt.find(db.lo.custkey[i]);
-                if (cust_it != hm_cust_pt.end()) {
-                  uint16_t d_year = hm_date.find(db.lo.orderdate[i])->second;
-                  std::pair<bool, int64_t> &slot =
-                      acc[((d_year - 1992) << 5) | cust_it->second];
-                  slot.first = true;
-                  slot.second += db.lo.revenue[i] - db.lo.supplycost[i];
-                }
-              }
+            if (america.contains(dims.s_region[i]) &&
+                america.contains(dims.c_region[i]) &&
+                mfgr1_2.contains(dims.p_mfgr[i])) {
+              Q4P1Key::add(acc,
+                           Q4P1Key::pack(dims.d_year[i], dims.c_nation[i]),
+                           lo.revenue[i] - lo.supplycost[i]);
             }
           }
           return acc;
         },
-        agg_merge);
-  });
+        Q4P1Key::merge);
+  }
 
-  log("Q4.1", "Probe", latency);
+  size_t scan_bytes(const LineorderDims &dims) const override {
+    return column_bytes(dims.d_year,
+                        dims.c_nation,
+                        dims.c_region,
+                        dims.s_region,
+                        dims.p_mfgr);
+  }
 
-  latency = time([&] { q4p1_finalize(acc, result); });
+  Bitmap filter(const BitmapIndex &index) const override {
+    auto region = [&](uint32_t region) { return america.contains(region); };
+    return select(index.c_region, region) & select(index.s_region, region) &
+           select(index.p_mfgr,
+                  [&](uint32_t mfgr) { return mfgr1_2.contains(mfgr); });
+  }
 
-  log("Q4.1", "Finalize", latency);
+  bool rollup(const Cubes &cubes, Accumulator &acc) const override {
+    std::vector<std::vector<int32_t>> values(4);
+    if (!classify(db.d.datekey,
+                  cubes.d_year,
+                  [&](uint32_t key) { return value(hm_date, key); },
+                  values[0]) ||
+        !classify(db.c.custkey,
+                  cubes.c_nation,
+                  [&](uint32_t key) {
+                    return value(hm_customer[key % n_pt], key);
+                  },
+                  values[1]) ||
+        !classify(db.s.suppkey,
+                  cubes.s_nation,
+                  [&](uint32_t key) { return member(hs_supplier, key); },
+                  values[2]) ||
+        !classify(db.p.partkey,
+                  cubes.p_category,
+                  [&](uint32_t key) {
+                    return member(hs_part[key % n_pt], key);
+                  },
+                  values[3])) {
+      return false;
+    }
 
-  print(result);
+    acc = Q4P1Key::make();
+    ::rollup(cubes.q4, values, [&](const int32_t *cell, int64_t sum) {
+      Q4P1Key::add(acc, Q4P1Key::pack(cell[0], cell[1]), sum);
+    });
+    return true;
+  }
 
-  std::vector<std::tuple<uint32_t, uint32_t, uint16_t, uint8_t>> agg_input;
-  for (size_t i = 0; i < db.lo.orderdate.size(); ++i) {
-    if (hs_supplier.contains(db.lo.suppkey[i])) {
-      auto &hs_part_pt = hs_part[db.lo.partkey[i] % n_pt];
-      if (hs_part_pt.contains(db.lo.partkey[i])) {
-        auto &hm_cust_pt = hm_customer[db.lo.custkey[i] % n_pt];
-        auto cust_it = hm_cust_pt.find(db.lo.custkey[i]);
-        if (cust_it != hm_cust_pt.end()) {
-          uint16_t d_year = hm_date.find(db.lo.orderdate[i])->second;
-          agg_input.emplace_back(
-              db.lo.revenue[i], db.lo.supplycost[i], d_year, cust_it->second);
-        }
-      }
-    }
+  void finalize(const Accumulator &acc) override {
+    q4p1_finalize(acc, result);
   }
 
-  latency = time([&] {
-    acc = tbb::parallel_reduce(
-        tbb::blocked_range<size_t>(0, agg_input.size()),
-        Accumulator(256),
+  size_t slot(size_t i) const override {
+    return Q4P1Key::pack(result[i].d_year, result[i].c_nation);
+  }
+
+private:
+  Accumulator probe_prefetched(const Lineorder &lo) const {
+    return tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, lo.orderdate.size()),
+        Q4P1Key::make(),
         [&](const tbb::blocked_range<size_t> &r, Accumulator acc) {
-          for (size_t i = r.begin(); i < r.end(); ++i) {
-            auto &[lo_revenue, lo_supplycost, d_year, c_nation] = agg_input[i];
-            std::pair<bool, int64_t> &slot =
-                acc[((d_year - 1992) << 5) | c_nation];
-            slot.first = true;
-            slot.second += lo_revenue - lo_supplycost;
-          }
+          uint8_t c_nation[prefetch_group];
+          uint16_t d_year[prefetch_group];
+          probe_grouped(
+              r.begin(),
+              r.end(),
+              [&](size_t i, size_t j) {
+                Q4P1Key::add(acc,
+                             Q4P1Key::pack(d_year[j], c_nation[j]),
+                             lo.revenue[i] - lo.supplycost[i]);
+              },
+              stage(
+                  [&](size_t i) { hs_supplier.prefetch(lo.suppkey[i]); },
+                  [&](size_t i, size_t) {
+                    return hs_supplier.contains(lo.suppkey[i]);
+                  }),
+              stage(
+                  [&](size_t i) {
+                    hs_part[lo.partkey[i] % n_pt].prefetch(lo.partkey[i]);
+                  },
+                  [&](size_t i, size_t) {
+                    auto &hs = hs_part[lo.partkey[i] % n_pt];
+                    return hs.contains(lo.partkey[i]);
+                  }),
+              stage(
+                  [&](size_t i) {
+                    hm_customer[lo.custkey[i] % n_pt].prefetch(lo.custkey[i]);
+                  },
+                  [&](size_t i, size_t j) {
+                    auto &hm = hm_customer[lo.custkey[i] % n_pt];
+                    auto it = hm.find(lo.custkey[i]);
+                    if (it == hm.end()) {
+                      return false;
+                    }
+                    c_nation[j] = it->second;
+                    return true;
+                  }),
+              stage(
+                  [&](size_t i) { hm_date.prefetch(lo.orderdate[i]); },
+                  [&](size_t i, size_t j) {
+                    d_year[j] = hm_date.find(lo.orderdate[i])->second;
+                    return true;
+                  }));
           return acc;
         },
-        agg_merge);
-  });
-
-  log("Q4.1", "Agg", latency);
+        Q4P1Key::merge);
+  }
 
-  q4p1_finalize(acc, result);
+  const Database &db;
+  CodeRange america;
+  CodeRange mfgr1_2;
+  hash_map<uint32_t, uint16_t> hm_date;
+  std::vector<hash_map<uint32_t, uint8_t>> hm_customer;
+  hash_set<uint32_t> hs_supplier;
+  std::vector<hash_set<uint32_t>> hs_part;
+};
 
-  print(result);
+std::unique_ptr<Query> q4p1(const Database &db) {
+  return std::make_unique<Q4P1>(db);
 }
 
-void q4p2_finalize(Accumulator &acc, std::vector<Q4P2Row> &result) {
+using Q4P2Nation = Dim<uint8_t, 1, 25>;
+using Q4P2Category = Dim<uint8_t, 1, 10>;
+using Q4P2Key = GroupKey<Dim<uint16_t, 1997, 1998>, Q4P2Nation, Q4P2Category>;
+
+void q4p2_finalize(const Q4P2Key::accumulator &acc,
+                   std::vector<Q4P2Row> &result) {
   result.clear();
   result.reserve(acc.size());
-  for (size_t i = 0; i < acc.size(); ++i) {
-    if (acc[i].first) {
-      uint16_t d_year = (i >> 9) + 1997;
-      uint8_t s_nation = (i >> 4) & 0b11111;
-      uint8_t p_category = i & 0b1111;
-      result.emplace_back(d_year, s_nation, p_category, acc[i].second);
-    }
-  }
+  Q4P2Key::decode(acc, result);
   std::sort(
       result.begin(), result.end(), [](const Q4P2Row &a, const Q4P2Row &b) {
         return a.d_year < b.d_year ||
@@ -236,159 +389,326 @@ void q4p2_finalize(Accumulator &acc, std::vector<Q4P2Row> &result) {
       });
 }
 
-void q4p2(const Database &db) {
-  double latency;
-  std::vector<Q4P2Row> result;
+class Q4P2 : public RowQuery<Q4P2Row> {
+public:
+  explicit Q4P2(const Database &db)
+      : RowQuery("Q4.2"), db(db), america(db.dicts.region.equal("AMERICA")),
+        mfgr1_2(db.dicts.mfgr.between("MFGR#1", "MFGR#2")), hs_customer(n_pt),
+        hm_part(n_pt) {
+    check_domain<Q4P2Nation>(db.dicts.nation.prefix(""));
+    check_domain<Q4P2Category>(
+        db.dicts.category.between("MFGR#11", "MFGR#25"));
+  }
 
-  hash_map<uint32_t, uint16_t> hm_date;
-  latency = time([&] {
-    for (size_t i = 0; i < db.d.datekey.size(); ++i) {
-      if (db.d.year[i] == 1997 || db.d.year[i] == 1998) {
-        hm_date.emplace(db.d.datekey[i], db.d.year[i]);
-      }
-    }
-  });
+  ColumnSet columns() const override {
+    return col::d_datekey | col::d_year | col::c_custkey | col::c_region |
+           col::s_suppkey | col::s_nation | col::s_region | col::p_partkey |
+           col::p_mfgr | col::p_category | col::lo_custkey | col::lo_partkey |
+           col::lo_suppkey | col::lo_orderdate | col::lo_revenue |
+           col::lo_supplycost;
+  }
 
-  log("Q4.2", "BuildHashMapDate", latency);
+  void build() override {
+    double latency;
 
-  std::vector<hash_set<uint32_t>> hs_customer(n_pt);
-  latency = time([&] {
-    tbb::parallel_for(size_t(0), n_pt, [&](size_t i) {
-      const Customer &c_pt = db.c_pt[i];
-      for (size_t j = 0; j < c_pt.custkey.size(); ++j) {
-        if (c_pt.region[j] == 2) {
-          hs_customer[i].emplace(c_pt.custkey[j]);
+    latency = time([&] {
+      for (size_t i = 0; i < db.d.datekey.size(); ++i) {
+        if (db.d.year[i] == 1997 || db.d.year[i] == 1998) {
+          hm_date.emplace(db.d.datekey[i], db.d.year[i]);
         }
       }
     });
-  });
 
-  log("Q4.2", "BuildHashSetCustomer", latency);
+    log(name, "BuildHashMapDate", latency);
 
-  hash_map<uint32_t, uint8_t> hm_supplier;
-  latency = time([&] {
-    for (size_t i = 0; i < db.s.suppkey.size(); ++i) {
-      if (db.s.region[i] == 2) {
-        hm_supplier.emplace(db.s.suppkey[i], db.s.nation[i]);
+    latency = time([&] {
+      tbb::parallel_for(size_t(0), n_pt, [&](size_t i) {
+        for (size_t j = db.c_pt.begin(i); j < db.c_pt.end(i); ++j) {
+          if (america.contains(db.c.region[j])) {
+            hs_customer[i].emplace(db.c.custkey[j]);
+          }
+        }
+      });
+    });
+
+    log(name, "BuildHashSetCustomer", latency);
+
+    latency = time([&] {
+      for (size_t i = 0; i < db.s.suppkey.size(); ++i) {
+        if (america.contains(db.s.region[i])) {
+          hm_supplier.emplace(db.s.suppkey[i], db.s.nation[i]);
+        }
       }
+    });
+
+    log(name, "BuildHashMapSupplier", latency);
+
+    latency = time([&] {
+      tbb::parallel_for(size_t(0), n_pt, [&](size_t i) {
+        hm_part[i].reserve(db.p_pt.size(i));
+        for (size_t j = db.p_pt.begin(i); j < db.p_pt.end(i); ++j) {
+          if (mfgr1_2.contains(db.p.mfgr[j])) {
+            hm_part[i].emplace(db.p.partkey[j], db.p.category[j]);
+          }
+        }
+      });
+    });
+
+    log(name, "BuildHashMapPart", latency);
+  }
+
+  void log_bytes() const override {
+    log(name, "HashMapDateBytes", allocated_bytes(hm_date));
+    log(name, "HashSetCustomerBytes", allocated_bytes(hs_customer));
+    log(name, "HashMapSupplierBytes", allocated_bytes(hm_supplier));
+    log(name, "HashMapPartBytes", allocated_bytes(hm_part));
+    log(name, "AccumulatorBytes", Q4P2Key::bytes);
+  }
+
+  // The probe's joins over lo, in order.
+  auto stages(const Lineorder &lo) const {
+    return pipeline::scan(lo)
+        .join(hm_supplier, lo.suppkey)
+        .join(hm_date, lo.orderdate)
+        .semijoin(hs_customer, lo.custkey)
+        .join(hm_part, lo.partkey);
+  }
+
+  Accumulator probe(const Lineorder &lo) const override {
+    if (prefetch) {
+      return probe_prefetched(lo);
     }
-  });
-
-  log("Q4.2", "BuildHashMapSupplier", latency);
-
-  std::vector<hash_map<uint32_t, uint8_t>> hm_part(n_pt);
-  latency = time([&] {
-    tbb::parallel_for(size_t(0), n_pt, [&](size_t i) {
-      const Part &p_pt = db.p_pt[i];
-      hm_part[i].reserve(p_pt.partkey.size());
-      for (size_t j = 0; j < p_pt.partkey.size(); ++j) {
-        if (p_pt.mfgr[j] == 1 || p_pt.mfgr[j] == 2) {
-          hm_part[i].emplace(p_pt.partkey[j], p_pt.category[j]);
+
+    return stages(lo).groupby<Q4P2Key, 1, 0, 2>().sum(
+        [&](size_t i) { return lo.revenue[i] - lo.supplycost[i]; });
+  }
+
+  size_t probe_bytes(const Lineorder &lo) const override {
+    return stages(lo).read_bytes(lo.revenue, lo.supplycost);
+  }
+
+  Accumulator agg(const Lineorder &lo) const override {
+    double latency;
+    Accumulator acc;
+
+    std::vector<std::tuple<uint32_t, uint32_t, uint16_t, uint8_t, uint8_t>>
+        agg_input;
+    for (size_t i = 0; i < lo.orderdate.size(); ++i) {
+      auto supp_it = hm_supplier.find(lo.suppkey[i]);
+      if (supp_it != hm_supplier.end()) {
+        auto date_it = hm_date.find(lo.orderdate[i]);
+        if (date_it != hm_date.end()) {
+          auto &hs_cust_pt = hs_customer[lo.custkey[i] % n_pt];
+          if (hs_cust_pt.contains(lo.custkey[i])) {
+            auto &hm_part_pt = hm_part[lo.partkey[i] % n_pt];
+            auto part_it = hm_part_pt.find(lo.partkey[i]);
+            if (part_it != hm_part_pt.end()) {
+              agg_input.emplace_back(lo.revenue[i],
+                                     lo.supplycost[i],
+                                     date_it->second,
+                                     supp_it->second,
+                                     part_it->second);
+            }
+          }
         }
       }
+    }
+
+    latency = time([&] {
+      acc = tbb::parallel_reduce(
+          tbb::blocked_range<size_t>(0, agg_input.size()),
+          Q4P2Key::make(),
+          [&](const tbb::blocked_range<size_t> &r, Accumulator acc) {
+            for (size_t i = r.begin(); i < r.end(); ++i) {
+              auto &[lo_revenue, lo_supplycost, d_year, s_nation, p_category] =
+                  agg_input[i];
+              Q4P2Key::add(acc,
+                           Q4P2Key::pack(d_year, s_nation, p_category),
+                           lo_revenue - lo_supplycost);
+            }
+            return acc;
+          },
+          Q4P2Key::merge);
     });
-  });
 
-  log("Q4.2", "BuildHashMapPart", latency);
+    log(name, "Agg", latency);
+    log(name, "AggInputBytes", allocated_bytes(agg_input));
+    log_bandwidth(name, "Agg", column_bytes(agg_input), latency);
+
+    return acc;
+  }
 
-  Accumulator acc;
-  latency = time([&] {
-    acc = tbb::parallel_reduce(
-        tbb::blocked_range<size_t>(0, db.lo.orderdate.size()),
-        Accumulator(1024),
+  Accumulator scan(const Lineorder &lo,
+                   const LineorderDims &dims) const override {
+    return tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, lo.orderdate.size()),
+        Q4P2Key::make(),
         [&](const tbb::blocked_range<size_t> &r, Accumulator acc) {
           for (size_t i = r.begin(); i < r.end(); ++i) {
-            auto supp_it = hm_supplier.find(db.lo.suppkey[i]);
-            if (supp_it != hm_supplier.end()) {
-              auto date_it = hm_date.find(db.lo.orderdate[i]);
-              if (date_it != hm_date.end()) {
-                auto &hs_cust_pt = hs_customer[db.lo.custkey[i] % n_pt];
-                if (hs_cust_pt.contains(db.lo.custkey[i])) {
-                  auto &hm_part_pt = hm_part[db.lo.partkey[i] % n_pt];
-                  auto part_it = hm_part_pt.find(db.lo.partkey[i]);
-                  if (part_it != hm_part_pt.end()) {
-                    std::pair<bool, int64_t> &slot =
-                        acc[((date_it->second - 1997) << 9) |
-                            (supp_it->second << 4) | part_it->second];
-                    slot.first = true;
-                    slot.second += db.lo.revenue[i] - db.lo.supplycost[i];
-                  }
-                }
-              }
+            if (america.contains(dims.s_region[i]) &&
+                (dims.d_year[i] == 1997 || dims.d_year[i] == 1998) &&
+                america.contains(dims.c_region[i]) &&
+                mfgr1_2.contains(dims.p_mfgr[i])) {
+              Q4P2Key::add(acc,
+                           Q4P2Key::pack(dims.d_year[i],
+                                         dims.s_nation[i],
+                                         dims.p_category[i]),
+                           lo.revenue[i] - lo.supplycost[i]);
             }
           }
           return acc;
         },
-        agg_merge);
-  });
-
-  log("Q4.2", "Probe", latency);
-
-  latency = time([&] { q4p2_finalize(acc, result); });
-
-  log("Q4.2", "Finalize", latency);
-
-  print(result);
-
-  std::vector<std::tuple<uint32_t, uint32_t, uint16_t, uint8_t, uint8_t>>
-      agg_input;
-  for (size_t i = 0; i < db.lo.orderdate.size(); ++i) {
-    auto supp_it = hm_supplier.find(db.lo.suppkey[i]);
-    if (supp_it != hm_supplier.end()) {
-      auto date_it = hm_date.find(db.lo.orderdate[i]);
-      if (date_it != hm_date.end()) {
-        auto &hs_cust_pt = hs_customer[db.lo.custkey[i] % n_pt];
-        if (hs_cust_pt.contains(db.lo.custkey[i])) {
-          auto &hm_part_pt = hm_part[db.lo.partkey[i] % n_pt];
-          auto part_it = hm_part_pt.find(db.lo.partkey[i]);
-          if (part_it != hm_part_pt.end()) {
-            agg_input.emplace_back(db.lo.revenue[i],
-                                   db.lo.supplycost[i],
-                                   date_it->second,
-                                   supp_it->second,
-                                   part_it->second);
-          }
-        }
-      }
+        Q4P2Key::merge);
+  }
+
+  size_t scan_bytes(const LineorderDims &dims) const override {
+    return column_bytes(dims.d_year,
+                        dims.c_region,
+                        dims.s_nation,
+                        dims.s_region,
+                        dims.p_mfgr,
+                        dims.p_category);
+  }
+
+  Bitmap filter(const BitmapIndex &index) const override {
+    auto region = [&](uint32_t region) { return america.contains(region); };
+    return select(index.d_year,
+                  [](uint32_t year) { return year == 1997 || year == 1998; }) &
+           select(index.c_region, region) & select(index.s_region, region) &
+           select(index.p_mfgr,
+                  [&](uint32_t mfgr) { return mfgr1_2.contains(mfgr); });
+  }
+
+  bool rollup(const Cubes &cubes, Accumulator &acc) const override {
+    std::vector<std::vector<int32_t>> values(4);
+    if (!classify(db.d.datekey,
+                  cubes.d_year,
+                  [&](uint32_t key) { return value(hm_date, key); },
+                  values[0]) ||
+        !classify(db.c.custkey,
+                  cubes.c_nation,
+                  [&](uint32_t key) {
+                    return member(hs_customer[key % n_pt], key);
+                  },
+                  values[1]) ||
+        !classify(db.s.suppkey,
+                  cubes.s_nation,
+                  [&](uint32_t key) { return value(hm_supplier, key); },
+                  values[2]) ||
+        !classify(db.p.partkey,
+                  cubes.p_category,
+                  [&](uint32_t key) {
+                    return value(hm_part[key % n_pt], key);
+                  },
+                  values[3])) {
+      return false;
     }
+
+    acc = Q4P2Key::make();
+    ::rollup(cubes.q4, values, [&](const int32_t *cell, int64_t sum) {
+      Q4P2Key::add(acc, Q4P2Key::pack(cell[0], cell[2], cell[3]), sum);
+    });
+    return true;
   }
 
-  latency = time([&] {
-    acc = tbb::parallel_reduce(
-        tbb::blocked_range<size_t>(0, agg_input.size()),
-        Accumulator(1024),
+  void finalize(const Accumulator &acc) override {
+    q4p2_finalize(acc, result);
+  }
+
+  size_t slot(size_t i) const override {
+    const Q4P2Row &row = result[i];
+    return Q4P2Key::pack(row.d_year, row.s_nation, row.p_category);
+  }
+
+private:
+  Accumulator probe_prefetched(const Lineorder &lo) const {
+    return tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, lo.orderdate.size()),
+        Q4P2Key::make(),
         [&](const tbb::blocked_range<size_t> &r, Accumulator acc) {
-          for (size_t i = r.begin(); i < r.end(); ++i) {
-            auto &[lo_revenue, lo_supplycost, d_year, s_nation, p_category] =
-                agg_input[i];
-            std::pair<bool, int64_t> &slot =
-                acc[((d_year - 1997) << 9) | (s_nation << 4) | p_category];
-            slot.first = true;
-            slot.second += lo_revenue - lo_supplycost;
-          }
+          uint8_t s_nation[prefetch_group];
+          uint16_t d_year[prefetch_group];
+          uint8_t p_category[prefetch_group];
+          probe_grouped(
+              r.begin(),
+              r.end(),
+              [&](size_t i, size_t j) {
+                Q4P2Key::add(acc,
+                             Q4P2Key::pack(d_year[j],
+                                           s_nation[j],
+                                           p_category[j]),
+                             lo.revenue[i] - lo.supplycost[i]);
+              },
+              stage(
+                  [&](size_t i) { hm_supplier.prefetch(lo.suppkey[i]); },
+                  [&](size_t i, size_t j) {
+                    auto &hm = hm_supplier;
+                    auto it = hm.find(lo.suppkey[i]);
+                    if (it == hm.end()) {
+                      return false;
+                    }
+                    s_nation[j] = it->second;
+                    return true;
+                  }),
+              stage(
+                  [&](size_t i) { hm_date.prefetch(lo.orderdate[i]); },
+                  [&](size_t i, size_t j) {
+                    auto &hm = hm_date;
+                    auto it = hm.find(lo.orderdate[i]);
+                    if (it == hm.end()) {
+                      return false;
+                    }
+                    d_year[j] = it->second;
+                    return true;
+                  }),
+              stage(
+                  [&](size_t i) {
+                    hs_customer[lo.custkey[i] % n_pt].prefetch(lo.custkey[i]);
+                  },
+                  [&](size_t i, size_t) {
+                    auto &hs = hs_customer[lo.custkey[i] % n_pt];
+                    return hs.contains(lo.custkey[i]);
+                  }),
+              stage(
+                  [&](size_t i) {
+                    hm_part[lo.partkey[i] % n_pt].prefetch(lo.partkey[i]);
+                  },
+                  [&](size_t i, size_t j) {
+                    auto &hm = hm_part[lo.partkey[i] % n_pt];
+                    auto it = hm.find(lo.partkey[i]);
+                    if (it == hm.end()) {
+                      return false;
+                    }
+                    p_category[j] = it->second;
+                    return true;
+                  }));
           return acc;
         },
-        agg_merge);
-  });
-
-  log("Q4.2", "Agg", latency);
+        Q4P2Key::merge);
+  }
 
-  q4p2_finalize(acc, result);
+  const Database &db;
+  CodeRange america;
+  CodeRange mfgr1_2;
+  hash_map<uint32_t, uint16_t> hm_date;
+  std::vector<hash_set<uint32_t>> hs_customer;
+  hash_map<uint32_t, uint8_t> hm_supplier;
+  std::vector<hash_map<uint32_t, uint8_t>> hm_part;
+};
 
-  print(result);
+std::unique_ptr<Query> q4p2(const Database &db) {
+  return std::make_unique<Q4P2>(db);
 }
 
-void q4p3_finalize(Accumulator &acc, std::vector<Q4P3Row> &result) {
+using Q4P3City = Dim<uint8_t, 231, 240>;
+using Q4P3Brand = Dim<uint16_t, 121, 160>;
+using Q4P3Key = GroupKey<Dim<uint16_t, 1997, 1998>, Q4P3City, Q4P3Brand>;
+
+void q4p3_finalize(const Q4P3Key::accumulator &acc,
+                   std::vector<Q4P3Row> &result) {
   result.clear();
   result.reserve(acc.size());
-  for (size_t i = 0; i < acc.size(); ++i) {
-    if (acc[i].first) {
-      uint16_t d_year = (i >> 10) + 1997;
-      uint8_t s_city = ((i >> 6) & 0b1111) + 231;
-      uint16_t p_brand1 = (i & 0b111111) + 121;
-      result.emplace_back(d_year, s_city, p_brand1, acc[i].second);
-    }
-  }
+  Q4P3Key::decode(acc, result);
   std::sort(
       result.begin(), result.end(), [](const Q4P3Row &a, const Q4P3Row &b) {
         return a.d_year < b.d_year ||
@@ -398,146 +718,319 @@ void q4p3_finalize(Accumulator &acc, std::vector<Q4P3Row> &result) {
       });
 }
 
-void q4p3(const Database &db) {
-  double latency;
-  std::vector<Q4P3Row> result;
 
-  hash_map<uint32_t, uint16_t> hm_date;
-  latency = time([&] {
-    for (size_t i = 0; i < db.d.datekey.size(); ++i) {
-      if (db.d.year[i] == 1997 || db.d.year[i] == 1998) {
-        hm_date.emplace(db.d.datekey[i], db.d.year[i]);
-      }
-    }
-  });
+class Q4P3 : public RowQuery<Q4P3Row> {
+public:
+  explicit Q4P3(const Database &db)
+      : RowQuery("Q4.3"), db(db), america(db.dicts.region.equal("AMERICA")),
+        united_states(db.dicts.nation.equal("UNITED STATES")),
+        mfgr14(db.dicts.category.equal("MFGR#14")), hs_customer(n_pt),
+        hm_part(n_pt) {
+    check_domain<Q4P3City>(db.dicts.city.prefix("UNITED ST"));
+    check_domain<Q4P3Brand>(db.dicts.brand1.prefix("MFGR#14"));
+  }
+
+  ColumnSet columns() const override {
+    return col::d_datekey | col::d_year | col::c_custkey | col::c_region |
+           col::s_suppkey | col::s_city | col::s_nation | col::p_partkey |
+           col::p_category | col::p_brand1 | col::lo_custkey |
+           col::lo_partkey | col::lo_suppkey | col::lo_orderdate |
+           col::lo_revenue | col::lo_supplycost;
+  }
 
-  log("Q4.3", "BuildHashMapDate", latency);
+  void build() override {
+    double latency;
 
-  std::vector<hash_set<uint32_t>> hs_customer(n_pt);
-  latency = time([&] {
-    tbb::parallel_for(size_t(0), n_pt, [&](size_t i) {
-      const Customer &c_pt = db.c_pt[i];
-      for (size_t j = 0; j < c_pt.custkey.size(); ++j) {
-        if (c_pt.region[j] == 2) {
-          hs_customer[i].emplace(c_pt.custkey[j]);
+    latency = time([&] {
+      for (size_t i = 0; i < db.d.datekey.size(); ++i) {
+        if (db.d.year[i] == 1997 || db.d.year[i] == 1998) {
+          hm_date.emplace(db.d.datekey[i], db.d.year[i]);
         }
       }
     });
-  });
 
-  log("Q4.3", "BuildHashSetCustomer", latency);
+    log(name, "BuildHashMapDate", latency);
 
-  hash_map<uint32_t, uint8_t> hm_supplier;
-  latency = time([&] {
-    for (size_t i = 0; i < db.s.suppkey.size(); ++i) {
-      if (db.s.nation[i] == 24) {
-        hm_supplier.emplace(db.s.suppkey[i], db.s.city[i]);
+    latency = time([&] {
+      tbb::parallel_for(size_t(0), n_pt, [&](size_t i) {
+        for (size_t j = db.c_pt.begin(i); j < db.c_pt.end(i); ++j) {
+          if (america.contains(db.c.region[j])) {
+            hs_customer[i].emplace(db.c.custkey[j]);
+          }
+        }
+      });
+    });
+
+    log(name, "BuildHashSetCustomer", latency);
+
+    latency = time([&] {
+      for (size_t i = 0; i < db.s.suppkey.size(); ++i) {
+        if (united_states.contains(db.s.nation[i])) {
+          hm_supplier.emplace(db.s.suppkey[i], db.s.city[i]);
+        }
       }
+    });
+
+    log(name, "BuildHashMapSupplier", latency);
+
+    latency = time([&] {
+      tbb::parallel_for(size_t(0), n_pt, [&](size_t i) {
+        hm_part[i].reserve(db.p_pt.size(i));
+        for (size_t j = db.p_pt.begin(i); j < db.p_pt.end(i); ++j) {
+          if (mfgr14.contains(db.p.category[j])) {
+            hm_part[i].emplace(db.p.partkey[j], db.p.brand1[j]);
+          }
+        }
+      });
+    });
+
+    log(name, "BuildHashMapPart", latency);
+  }
+
+  void log_bytes() const override {
+    log(name, "HashMapDateBytes", allocated_bytes(hm_date));
+    log(name, "HashSetCustomerBytes", allocated_bytes(hs_customer));
+    log(name, "HashMapSupplierBytes", allocated_bytes(hm_supplier));
+    log(name, "HashMapPartBytes", allocated_bytes(hm_part));
+    log(name, "AccumulatorBytes", Q4P3Key::bytes);
+  }
+
+  // The probe's joins over lo, in order.
+  auto stages(const Lineorder &lo) const {
+    return pipeline::scan(lo)
+        .join(hm_supplier, lo.suppkey)
+        .join(hm_date, lo.orderdate)
+        .semijoin(hs_customer, lo.custkey)
+        .join(hm_part, lo.partkey);
+  }
+
+  Accumulator probe(const Lineorder &lo) const override {
+    if (prefetch) {
+      return probe_prefetched(lo);
     }
-  });
-
-  log("Q4.3", "BuildHashMapSupplier", latency);
-
-  std::vector<hash_map<uint32_t, uint16_t>> hm_part(n_pt);
-  latency = time([&] {
-    tbb::parallel_for(size_t(0), n_pt, [&](size_t i) {
-      const Part &p_pt = db.p_pt[i];
-      hm_part[i].reserve(p_pt.partkey.size());
-      for (size_t j = 0; j < p_pt.partkey.size(); ++j) {
-        if (p_pt.category[j] == 4) {
-          hm_part[i].emplace(p_pt.partkey[j], p_pt.brand1[j]);
+
+    return stages(lo).groupby<Q4P3Key, 1, 0, 2>().sum(
+        [&](size_t i) { return lo.revenue[i] - lo.supplycost[i]; });
+  }
+
+  size_t probe_bytes(const Lineorder &lo) const override {
+    return stages(lo).read_bytes(lo.revenue, lo.supplycost);
+  }
+
+  Accumulator agg(const Lineorder &lo) const override {
+    double latency;
+    Accumulator acc;
+
+    std::vector<std::tuple<uint32_t, uint32_t, uint16_t, uint8_t, uint16_t>>
+        agg_input;
+    for (size_t i = 0; i < lo.orderdate.size(); ++i) {
+      auto supp_it = hm_supplier.find(lo.suppkey[i]);
+      if (supp_it != hm_supplier.end()) {
+        auto date_it = hm_date.find(lo.orderdate[i]);
+        if (date_it != hm_date.end()) {
+          auto &hs_cust_pt = hs_customer[lo.custkey[i] % n_pt];
+          if (hs_cust_pt.contains(lo.custkey[i])) {
+            auto &hm_part_pt = hm_part[lo.partkey[i] % n_pt];
+            auto part_it = hm_part_pt.find(lo.partkey[i]);
+            if (part_it != hm_part_pt.end()) {
+              agg_input.emplace_back(lo.revenue[i],
+                                     lo.supplycost[i],
+                                     date_it->second,
+                                     supp_it->second,
+                                     part_it->second);
+            }
+          }
         }
       }
+    }
+
+    latency = time([&] {
+      acc = tbb::parallel_reduce(
+          tbb::blocked_range<size_t>(0, agg_input.size()),
+          Q4P3Key::make(),
+          [&](const tbb::blocked_range<size_t> &r, Accumulator acc) {
+            for (size_t i = r.begin(); i < r.end(); ++i) {
+              auto &[lo_revenue, lo_supplycost, d_year, s_city, p_brand1] =
+                  agg_input[i];
+              Q4P3Key::add(acc,
+                           Q4P3Key::pack(d_year, s_city, p_brand1),
+                           lo_revenue - lo_supplycost);
+            }
+            return acc;
+          },
+          Q4P3Key::merge);
     });
-  });
 
-  log("Q4.3", "BuildHashMapPart", latency);
+    log(name, "Agg", latency);
+    log(name, "AggInputBytes", allocated_bytes(agg_input));
+    log_bandwidth(name, "Agg", column_bytes(agg_input), latency);
+
+    return acc;
+  }
 
-  Accumulator acc;
-  latency = time([&] {
-    acc = tbb::parallel_reduce(
-        tbb::blocked_range<size_t>(0, db.lo.orderdate.size()),
-        Accumulator(2048),
+  Accumulator scan(const Lineorder &lo,
+                   const LineorderDims &dims) const override {
+    return tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, lo.orderdate.size()),
+        Q4P3Key::make(),
         [&](const tbb::blocked_range<size_t> &r, Accumulator acc) {
           for (size_t i = r.begin(); i < r.end(); ++i) {
-            auto supp_it = hm_supplier.find(db.lo.suppkey[i]);
-            if (supp_it != hm_supplier.end()) {
-              auto date_it = hm_date.find(db.lo.orderdate[i]);
-              if (date_it != hm_date.end()) {
-                auto &hs_cust_pt = hs_customer[db.lo.custkey[i] % n_pt];
-                if (hs_cust_pt.contains(db.lo.custkey[i])) {
-                  auto &hm_part_pt = hm_part[db.lo.partkey[i] % n_pt];
-                  auto part_it = hm_part_pt.find(db.lo.partkey[i]);
-                  if (part_it != hm_part_pt.end()) {
-                    std::pair<bool, int64_t> &slot =
-                        acc[((date_it->second - 1997) << 10) |
-                            ((supp_it->second - 231) << 6) |
-                            (part_it->second - 121)];
-                    slot.first = true;
-                    slot.second += db.lo.revenue[i] - db.lo.supplycost[i];
-                  }
-                }
-              }
+            if (united_states.contains(dims.s_nation[i]) &&
+                (dims.d_year[i] == 1997 || dims.d_year[i] == 1998) &&
+                america.contains(dims.c_region[i]) &&
+                mfgr14.contains(dims.p_category[i])) {
+              Q4P3Key::add(acc,
+                           Q4P3Key::pack(dims.d_year[i],
+                                         dims.s_city[i],
+                                         dims.p_brand1[i]),
+                           lo.revenue[i] - lo.supplycost[i]);
             }
           }
           return acc;
         },
-        agg_merge);
-  });
-
-  log("Q4.3", "Probe", latency);
-
-  latency = time([&] { q4p3_finalize(acc, result); });
-
-  log("Q4.3", "Finalize", latency);
-
-  print(result);
-
-  std::vector<std::tuple<uint32_t, uint32_t, uint16_t, uint8_t, uint16_t>>
-      agg_input;
-  for (size_t i = 0; i < db.lo.orderdate.size(); ++i) {
-    auto supp_it = hm_supplier.find(db.lo.suppkey[i]);
-    if (supp_it != hm_supplier.end()) {
-      auto date_it = hm_date.find(db.lo.orderdate[i]);
-      if (date_it != hm_date.end()) {
-        auto &hs_cust_pt = hs_customer[db.lo.custkey[i] % n_pt];
-        if (hs_cust_pt.contains(db.lo.custkey[i])) {
-          auto &hm_part_pt = hm_part[db.lo.partkey[i] % n_pt];
-          auto part_it = hm_part_pt.find(db.lo.partkey[i]);
-          if (part_it != hm_part_pt.end()) {
-            agg_input.emplace_back(db.lo.revenue[i],
-                                   db.lo.supplycost[i],
-                                   date_it->second,
-                                   supp_it->second,
-                                   part_it->second);
-          }
-        }
-      }
+        Q4P3Key::merge);
+  }
+
+  size_t scan_bytes(const LineorderDims &dims) const override {
+    return column_bytes(dims.d_year,
+                        dims.c_region,
+                        dims.s_city,
+                        dims.s_nation,
+                        dims.p_category,
+                        dims.p_brand1);
+  }
+
+  Bitmap filter(const BitmapIndex &index) const override {
+    return select(index.d_year,
+                  [](uint32_t year) { return year == 1997 || year == 1998; }) &
+           select(index.c_region,
+                  [&](uint32_t region) { return america.contains(region); }) &
+           select(index.s_nation,
+                  [&](uint32_t nation) {
+                    return united_states.contains(nation);
+                  }) &
+           select(index.p_category,
+                  [&](uint32_t category) { return mfgr14.contains(category); });
+  }
+
+  bool rollup(const Cubes &cubes, Accumulator &acc) const override {
+    std::vector<std::vector<int32_t>> values(4);
+    if (!classify(db.d.datekey,
+                  cubes.d_year,
+                  [&](uint32_t key) { return value(hm_date, key); },
+                  values[0]) ||
+        !classify(db.c.custkey,
+                  cubes.c_nation,
+                  [&](uint32_t key) {
+                    return member(hs_customer[key % n_pt], key);
+                  },
+                  values[1]) ||
+        !classify(db.s.suppkey,
+                  cubes.s_nation,
+                  [&](uint32_t key) { return value(hm_supplier, key); },
+                  values[2]) ||
+        !classify(db.p.partkey,
+                  cubes.p_category,
+                  [&](uint32_t key) {
+                    return value(hm_part[key % n_pt], key);
+                  },
+                  values[3])) {
+      return false;
     }
+
+    acc = Q4P3Key::make();
+    ::rollup(cubes.q4, values, [&](const int32_t *cell, int64_t sum) {
+      Q4P3Key::add(acc, Q4P3Key::pack(cell[0], cell[2], cell[3]), sum);
+    });
+    return true;
   }
 
-  latency = time([&] {
-    acc = tbb::parallel_reduce(
-        tbb::blocked_range<size_t>(0, agg_input.size()),
-        Accumulator(2048),
+  void finalize(const Accumulator &acc) override {
+    q4p3_finalize(acc, result);
+  }
+
+  size_t slot(size_t i) const override {
+    const Q4P3Row &row = result[i];
+    return Q4P3Key::pack(row.d_year, row.s_city, row.p_brand1);
+  }
+
+private:
+  Accumulator probe_prefetched(const Lineorder &lo) const {
+    return tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, lo.orderdate.size()),
+        Q4P3Key::make(),
         [&](const tbb::blocked_range<size_t> &r, Accumulator acc) {
-          for (size_t i = r.begin(); i < r.end(); ++i) {
-            auto &[lo_revenue, lo_supplycost, d_year, s_city, p_brand1] =
-                agg_input[i];
-            std::pair<bool, int64_t> &slot =
-                acc[((d_year - 1997) << 10) | ((s_city - 231) << 6) |
-                    (p_brand1 - 121)];
-            slot.first = true;
-            slot.second += lo_revenue - lo_supplycost;
-          }
+          uint8_t s_city[prefetch_group];
+          uint16_t d_year[prefetch_group];
+          uint16_t p_brand1[prefetch_group];
+          probe_grouped(
+              r.begin(),
+              r.end(),
+              [&](size_t i, size_t j) {
+                Q4P3Key::add(acc,
+                             Q4P3Key::pack(d_year[j], s_city[j], p_brand1[j]),
+                             lo.revenue[i] - lo.supplycost[i]);
+              },
+              stage(
+                  [&](size_t i) { hm_supplier.prefetch(lo.suppkey[i]); },
+                  [&](size_t i, size_t j) {
+                    auto &hm = hm_supplier;
+                    auto it = hm.find(lo.suppkey[i]);
+                    if (it == hm.end()) {
+                      return false;
+                    }
+                    s_city[j] = it->second;
+                    return true;
+                  }),
+              stage(
+                  [&](size_t i) { hm_date.prefetch(lo.orderdate[i]); },
+                  [&](size_t i, size_t j) {
+                    auto &hm = hm_date;
+                    auto it = hm.find(lo.orderdate[i]);
+                    if (it == hm.end()) {
+                      return false;
+                    }
+                    d_year[j] = it->second;
+                    return true;
+                  }),
+              stage(
+                  [&](size_t i) {
+                    hs_customer[lo.custkey[i] % n_pt].prefetch(lo.custkey[i]);
+                  },
+                  [&](size_t i, size_t) {
+                    auto &hs = hs_customer[lo.custkey[i] % n_pt];
+                    return hs.contains(lo.custkey[i]);
+                  }),
+              stage(
+                  [&](size_t i) {
+                    hm_part[lo.partkey[i] % n_pt].prefetch(lo.partkey[i]);
+                  },
+                  [&](size_t i, size_t j) {
+                    auto &hm = hm_part[lo.partkey[i] % n_pt];
+                    auto it = hm.find(lo.partkey[i]);
+                    if (it == hm.end()) {
+                      return false;
+                    }
+                    p_brand1[j] = it->second;
+                    return true;
+                  }));
           return acc;
         },
-        agg_merge);
-  });
-
-  log("Q4.3", "Agg", latency);
+        Q4P3Key::merge);
+  }
 
-  q4p3_finalize(acc, result);
+  const Database &db;
+  CodeRange america;
+  CodeRange united_states;
+  CodeRange mfgr14;
+  hash_map<uint32_t, uint16_t> hm_date;
+  std::vector<hash_set<uint32_t>> hs_customer;
+  hash_map<uint32_t, uint8_t> hm_supplier;
+  std::vector<hash_map<uint32_t, uint16_t>> hm_part;
+};
 
-  print(result);
+std::unique_ptr<Query> q4p3(const Database &db) {
+  return std::make_unique<Q4P3>(db);
 }
+
+} // namespace SSB_ISA
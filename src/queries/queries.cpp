@@ -0,0 +1,21 @@
+#include "../query.hpp"
+
+namespace SSB_ISA {
+
+std::vector<QueryFactory> query_factories() {
+  return {q1p1,
+          q1p2,
+          q1p3,
+          q2p1,
+          q2p2,
+          q2p3,
+          q3p1,
+          q3p2,
+          q3p3,
+          q3p4,
+          q4p1,
+          q4p2,
+          q4p3};
+}
+
+} // namespace SSB_ISA
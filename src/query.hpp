@@ -0,0 +1,189 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+class Bitmap;
+struct BitmapIndex;
+struct Cubes;
+
+// A query split into a dimension-side build and a lineorder-side probe, so
+// the probe can run over any set of lineorder rows and the partial
+// accumulators be merged before finalizing.
+class Query {
+public:
+  explicit Query(std::string name) : name(std::move(name)) {}
+
+  virtual ~Query() = default;
+
+  // The columns of the database that build(), probe() and agg() read.
+  virtual ColumnSet columns() const = 0;
+
+  // Builds the dimension hash tables, logging the latency of each.
+  virtual void build() = 0;
+
+  // Logs the bytes allocated by the hash tables build() made and by each
+  // accumulator probe() makes.
+  virtual void log_bytes() const = 0;
+
+  // Joins and aggregates the rows of lo.
+  virtual Accumulator probe(const Lineorder &lo) const = 0;
+
+  // Bytes of lo probe() reads: each stage's column at the rows that reach
+  // it, all of them for the first stage, then the measured columns at the
+  // rows that survive. Runs the probe's lookups again, without aggregating.
+  virtual size_t probe_bytes(const Lineorder &lo) const = 0;
+
+  // Materializes the joined rows of lo, then aggregates them, logging the
+  // latency of the aggregation alone.
+  virtual Accumulator agg(const Lineorder &lo) const = 0;
+
+  // Aggregates the rows of lo by filtering on their pre-joined dimension
+  // attributes, without hash tables.
+  virtual Accumulator scan(const Lineorder &lo,
+                           const LineorderDims &dims) const = 0;
+
+  // Bytes of the pre-joined columns scan() reads.
+  virtual size_t scan_bytes(const LineorderDims &dims) const = 0;
+
+  // Selects a superset of the lineorder rows that pass the query's
+  // predicates by combining bitmap join indexes.
+  virtual Bitmap filter(const BitmapIndex &index) const = 0;
+
+  // Answers the query by rolling up a pre-aggregated cube into acc. Returns
+  // false if no cube covers its predicates and group-by. Requires build().
+  virtual bool rollup(const Cubes &cubes, Accumulator &acc) const {
+    return false;
+  }
+
+  // Decodes a (merged) accumulator into sorted result rows.
+  virtual void finalize(const Accumulator &acc) = 0;
+
+  virtual void print() const = 0;
+
+  // The result rows, formatted as print() formats them.
+  virtual std::vector<std::string> rows() const = 0;
+
+  // The accumulator slot result row i was finalized from.
+  virtual size_t slot(size_t i) const = 0;
+
+  const std::string name;
+
+  // Whether probe() looks up groups of rows stage by stage with prefetches,
+  // rather than one row at a time.
+  bool prefetch = false;
+};
+
+// A query whose result is a vector of rows.
+template <typename Row> class RowQuery : public Query {
+public:
+  using Query::Query;
+
+  void print() const override { ::print(result); }
+
+  std::vector<std::string> rows() const override {
+    std::vector<std::string> rows;
+    for (const Row &row : result) {
+      std::ostringstream os;
+      os << row;
+      rows.push_back(os.str());
+    }
+    return rows;
+  }
+
+protected:
+  std::vector<Row> result;
+};
+
+using QueryFactory = std::unique_ptr<Query> (*)(const Database &db);
+
+// The query kernels are compiled once per instruction set (see isa.hpp), each
+// time with SSB_ISA naming a namespace of their own, so that the variants'
+// classes and functions stay apart.
+#ifdef SSB_ISA
+namespace SSB_ISA {
+std::unique_ptr<Query> q1p1(const Database &db);
+std::unique_ptr<Query> q1p2(const Database &db);
+std::unique_ptr<Query> q1p3(const Database &db);
+std::unique_ptr<Query> q2p1(const Database &db);
+std::unique_ptr<Query> q2p2(const Database &db);
+std::unique_ptr<Query> q2p3(const Database &db);
+std::unique_ptr<Query> q3p1(const Database &db);
+std::unique_ptr<Query> q3p2(const Database &db);
+std::unique_ptr<Query> q3p3(const Database &db);
+std::unique_ptr<Query> q3p4(const Database &db);
+std::unique_ptr<Query> q4p1(const Database &db);
+std::unique_ptr<Query> q4p2(const Database &db);
+std::unique_ptr<Query> q4p3(const Database &db);
+
+// This variant's factories of every query, in order.
+std::vector<QueryFactory> query_factories();
+} // namespace SSB_ISA
+#endif
+
+// The factories of the instruction set select_isa() selected, in order.
+inline std::vector<QueryFactory> queries;
+
+// Whether name is in the comma-separated list, or the list is "all".
+inline bool selected(const std::string &list, const std::string &name) {
+  if (list == "all") {
+    return true;
+  }
+  return ("," + list + ",").find("," + name + ",") != std::string::npos;
+}
+
+// Splits lineorder into n_shards rowid ranges, probes each in a worker
+// process holding its range plus the dimensions, and merges the partial
+// accumulators before finalizing.
+void run_sharded(const char *path, size_t n_shards);
+
+// Keeps only the dimensions in memory and feeds lineorder to every query in
+// chunks read sequentially from disk, reading the next chunk while probing the
+// current one. At most memory_mb MiB of lineorder are resident.
+void run_streaming(const char *path, size_t memory_mb);
+
+// Runs every query over the loaded database, then appends batches of
+// batch_rows lineorder rows read from tbl_path ("-" for stdin) and refreshes
+// each result by probing only the new rows.
+void run_appends(const char *path, const char *tbl_path, size_t batch_rows);
+
+// Builds pre-aggregated cubes at load time, then answers every query a cube
+// covers by rolling it up, and the others by probing lineorder.
+void run_cubes(const char *path);
+
+// Pre-joins the dimension attributes onto lineorder, then runs every query
+// both through its hash joins and as a scan over the joined columns.
+void run_denormalized(const char *path);
+
+// Builds bitmap join indexes at load time, then runs every query both over
+// all of lineorder and over only the rows its bitmap filter selects.
+void run_bitmaps(const char *path);
+
+// Probes a uniform sample of lineorder keeping each row with probability rate,
+// scales the sums into estimates with confidence intervals per group, and
+// reports their error against the exact result.
+void run_sampled(const char *path, double rate);
+
+// Aggregates lineorder by each of its foreign keys, with partitioned hash
+// aggregation where the key has too many values for a dense accumulator, and
+// prints the k groups with the largest sums.
+void run_top(const char *path, size_t k);
+
+// Reruns the build, probe and finalize of every query in the query list under
+// each thread count of the thread list, optionally pinning threads to CPUs
+// ("spread" over physical cores before SMT siblings, or "compact" onto
+// siblings first), and prints each phase's speedup and parallel efficiency.
+void run_sweep(const char *path,
+               const std::string &thread_list,
+               const std::string &query_list,
+               const std::string &pin);
+
+// Loads the database once, then serves query requests from clients of a
+// Unix-domain socket at socket_path, each on its own thread, until killed.
+// A "reload" request swaps in a freshly loaded database without stopping
+// the queries in flight.
+void run_server(const char *path, const char *socket_path);
@@ -0,0 +1,171 @@
+#include "query.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+
+// Number of independent replicates a sample is split into. The spread of
+// their estimates gives each group's standard error.
+constexpr size_t n_replicates = 10;
+
+// Two-sided 95% quantile of Student's t distribution with n_replicates - 1
+// degrees of freedom.
+constexpr double t_95 = 2.262;
+
+// A uniform sample of lineorder: each row is kept with probability rate and
+// assigned to one of n_replicates replicates at random.
+struct Sample {
+  double rate = 0;
+  std::vector<Lineorder> replicates;
+
+  size_t size() const {
+    size_t n = 0;
+    for (const Lineorder &lo : replicates) {
+      n += lo.orderdate.size();
+    }
+    return n;
+  }
+};
+
+// Draws a sample by skipping geometrically distributed runs of rows, so the
+// cost is proportional to the sample rather than to lineorder.
+Sample sample_lineorder(const Lineorder &lo, double rate, uint64_t seed) {
+  Sample sample{rate, std::vector<Lineorder>(n_replicates)};
+  std::mt19937_64 rng(seed);
+  std::geometric_distribution<size_t> skip(rate);
+  std::uniform_int_distribution<size_t> replicate(0, n_replicates - 1);
+
+  for (size_t i = skip(rng); i < lo.orderdate.size(); i += skip(rng) + 1) {
+    sample.replicates[replicate(rng)].push_back(lo, i);
+  }
+
+  return sample;
+}
+
+// Estimates of the sums of every group over all of lineorder, and the
+// half-widths of their 95% confidence intervals.
+struct Estimate {
+  Accumulator sums;
+  std::vector<double> errors;
+};
+
+// Each replicate is itself a uniform sample at rate / n_replicates, so
+// scaling its sums gives an independent estimate of every group's sum.
+Estimate estimate(const std::vector<Accumulator> &accs, double rate) {
+  size_t n_slots = accs.front().size();
+  Estimate e{Accumulator(n_slots), std::vector<double>(n_slots)};
+  std::vector<double> y(accs.size());
+
+  for (size_t g = 0; g < n_slots; ++g) {
+    double mean = 0;
+    for (size_t r = 0; r < accs.size(); ++r) {
+      e.sums[g].first = e.sums[g].first || accs[r][g].first;
+      y[r] = double(accs[r][g].second) * accs.size() / rate;
+      mean += y[r] / accs.size();
+    }
+
+    double variance = 0;
+    for (double y_r : y) {
+      variance += (y_r - mean) * (y_r - mean) / (accs.size() - 1);
+    }
+
+    e.sums[g].second = std::llround(mean);
+    e.errors[g] = t_95 * std::sqrt(variance / accs.size());
+  }
+
+  return e;
+}
+
+// The result rows of the estimate, each followed by the confidence interval
+// of the group it was finalized from.
+std::vector<std::string> interval_rows(Query &q, const Estimate &e) {
+  q.finalize(e.sums);
+
+  std::vector<std::string> rows = q.rows();
+  for (size_t i = 0; i < rows.size(); ++i) {
+    rows[i] += " +/- " + std::to_string(std::llround(e.errors[q.slot(i)]));
+  }
+  return rows;
+}
+
+// Logs the error of the estimate against the exact sums: the largest and
+// mean relative error over the exact groups, the fraction of them whose
+// interval covers the exact sum, and the number the sample missed.
+void log_error(const std::string &name,
+               const Accumulator &exact,
+               const Estimate &e) {
+  double max_error = 0;
+  double sum_error = 0;
+  size_t n_groups = 0;
+  size_t n_covered = 0;
+  size_t n_missed = 0;
+
+  for (size_t g = 0; g < exact.size(); ++g) {
+    if (!exact[g].first) {
+      continue;
+    }
+
+    double error = std::abs(double(e.sums[g].second - exact[g].second));
+    double relative =
+        exact[g].second == 0 ? 0 : error / std::abs(double(exact[g].second));
+
+    ++n_groups;
+    max_error = std::max(max_error, relative);
+    sum_error += relative;
+    n_covered += error <= e.errors[g];
+    n_missed += !e.sums[g].first;
+  }
+
+  log(name, "MaxRelError", max_error);
+  log(name, "MeanRelError", n_groups == 0 ? 0 : sum_error / n_groups);
+  log(name, "Coverage", n_groups == 0 ? 1 : double(n_covered) / n_groups);
+  log(name, "MissedGroups", n_missed);
+}
+
+void run_sampled(const char *path, double rate) {
+  if (!(rate > 0 && rate < 1)) {
+    throw std::runtime_error("sample rate must be in (0, 1)");
+  }
+
+  double latency;
+  Database db;
+  Sample sample;
+
+  load_dimensions(path, db);
+  load_lineorder(path, db.lo);
+
+  latency = time([&] { sample = sample_lineorder(db.lo, rate, 1); });
+
+  log("Sample", "Build", latency);
+  log("Sample", "Rows", sample.size());
+
+  for (QueryFactory make : queries) {
+    std::unique_ptr<Query> q = make(db);
+    q->build();
+
+    Accumulator exact;
+    latency = time([&] { exact = q->probe(db.lo); });
+
+    log(q->name, "Probe", latency);
+
+    std::vector<Accumulator> accs(n_replicates);
+    double sample_latency = time([&] {
+      for (size_t r = 0; r < n_replicates; ++r) {
+        accs[r] = q->probe(sample.replicates[r]);
+      }
+    });
+
+    log(q->name, "SampleProbe", sample_latency);
+    log(q->name, "SampleSpeedup", latency / sample_latency);
+
+    Estimate e = estimate(accs, rate);
+
+    log_error(q->name, exact, e);
+
+    q->finalize(exact);
+    q->print();
+
+    print(interval_rows(*q, e));
+  }
+}
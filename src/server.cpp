@@ -0,0 +1,348 @@
+#include "query.hpp"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+// Splits the bytes read from a connection into lines.
+class LineReader {
+public:
+  explicit LineReader(int fd) : fd(fd) {}
+
+  // Reads the next line, without its end of line. Returns false once the
+  // client has closed the connection.
+  bool read(std::string &line) {
+    while (true) {
+      size_t eol = buffer.find('\n');
+      if (eol != std::string::npos) {
+        line = buffer.substr(0, eol);
+        buffer.erase(0, eol + 1);
+        if (!line.empty() && line.back() == '\r') {
+          line.pop_back();
+        }
+        return true;
+      }
+
+      char chunk[4096];
+      ssize_t n = ::read(fd, chunk, sizeof(chunk));
+      if (n == 0) {
+        return false;
+      }
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw std::runtime_error(std::strerror(errno));
+      }
+      buffer.append(chunk, n);
+    }
+  }
+
+private:
+  int fd;
+  std::string buffer;
+};
+
+// A loaded database, numbered in load order.
+struct Snapshot {
+  uint64_t version = 0;
+  Database db;
+
+  // References held by requests, plus one while the snapshot is current.
+  std::atomic<uint64_t> refs{1};
+};
+
+// Publishes database snapshots to the clients without locks. A client holds
+// the snapshot it acquired for the whole of a request, so a request in
+// flight during a publish finishes on the old snapshot while later ones use
+// the new one.
+//
+// Counting a reference to the current snapshot takes two steps, reading its
+// address and incrementing its refs, and a publish in between could free
+// it. So current packs the address with, in its top bits, the number of
+// acquires that have read it but not yet counted themselves in its refs, and
+// both are read with a single fetch_add. A publish moves the pending count of
+// the snapshot it replaces into its refs. The top 16 bits allow for far more
+// acquires in flight at once than there are client threads.
+class Snapshots {
+public:
+  // A counted reference to a snapshot, released on destruction.
+  class Ref {
+  public:
+    Ref(Ref &&other) : snapshot(std::exchange(other.snapshot, nullptr)) {}
+    Ref &operator=(Ref &&other) {
+      reset();
+      snapshot = std::exchange(other.snapshot, nullptr);
+      return *this;
+    }
+
+    ~Ref() { reset(); }
+
+    const Snapshot &operator*() const { return *snapshot; }
+    const Snapshot *operator->() const { return snapshot; }
+
+    void reset() {
+      if (snapshot != nullptr) {
+        unref(std::exchange(snapshot, nullptr), 1);
+      }
+    }
+
+  private:
+    friend class Snapshots;
+
+    explicit Ref(Snapshot *snapshot) : snapshot(snapshot) {}
+
+    Snapshot *snapshot;
+  };
+
+  Snapshots() = default;
+  Snapshots(const Snapshots &) = delete;
+  Snapshots &operator=(const Snapshots &) = delete;
+
+  ~Snapshots() { replace(nullptr); }
+
+  // The current snapshot. There must be one.
+  Ref acquire() {
+    uint64_t word = current.fetch_add(one_pending) + one_pending;
+    Snapshot *snapshot = address(word);
+    snapshot->refs.fetch_add(1);
+
+    // Withdraw the pending acquire, unless a publish has already moved it
+    // into refs, in which case the reference it became is dropped instead.
+    while (address(word) == snapshot) {
+      if (current.compare_exchange_weak(word, word - one_pending)) {
+        return Ref(snapshot);
+      }
+    }
+    unref(snapshot, 1);
+    return Ref(snapshot);
+  }
+
+  void publish(std::unique_ptr<Snapshot> snapshot) {
+    if (uint64_t(snapshot.get()) >> address_bits != 0) {
+      throw std::runtime_error("snapshot address does not fit in 48 bits");
+    }
+    replace(snapshot.release());
+  }
+
+private:
+  static constexpr size_t address_bits = 48;
+  static constexpr uint64_t one_pending = uint64_t(1) << address_bits;
+
+  static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+  static Snapshot *address(uint64_t word) {
+    return (Snapshot *)(word & (one_pending - 1));
+  }
+
+  void replace(Snapshot *snapshot) {
+    uint64_t word = current.exchange(uint64_t(snapshot));
+    if (Snapshot *old = address(word)) {
+      old->refs.fetch_add(word >> address_bits);
+      unref(old, 1);
+    }
+  }
+
+  static void unref(Snapshot *snapshot, uint64_t n) {
+    if (snapshot->refs.fetch_sub(n) == n) {
+      retire(snapshot);
+    }
+  }
+
+  // Frees a replaced snapshot once its last reader releases it, on a thread
+  // of its own so that the reader does not pay for the deallocation.
+  static void retire(const Snapshot *snapshot) {
+    std::thread([snapshot] {
+      uint64_t version = snapshot->version;
+      delete snapshot;
+      log("Server", "Reclaim", version);
+    }).detach();
+  }
+
+  std::atomic<uint64_t> current{0};
+};
+
+// Loads a snapshot of the database at path.
+std::unique_ptr<Snapshot> load_snapshot(const std::string &path,
+                                        uint64_t version) {
+  double latency;
+  auto snapshot = std::make_unique<Snapshot>();
+  snapshot->version = version;
+
+  latency = time([&] {
+    load_dimensions(path.c_str(), snapshot->db);
+    load_lineorder(path.c_str(), snapshot->db.lo);
+  });
+
+  log("Server", "Load", latency);
+  log("Server", "Version", version);
+
+  return snapshot;
+}
+
+void send_line(int fd, const std::string &line) {
+  std::string data = line + '\n';
+  write_all(fd, data.data(), data.size());
+}
+
+// Runs the query a request names, "QUERY [prefetch]", on a fresh instance so
+// that concurrent requests share only the snapshot. Streams back its rows as
+// "row ROW", its phase latencies as "time PHASE SECONDS" and the version of
+// the snapshot it ran on.
+void serve_query(int fd,
+                 const Snapshot &snapshot,
+                 QueryFactory make,
+                 const std::string &option) {
+  if (!option.empty() && option != "prefetch") {
+    throw std::runtime_error("unknown option " + option);
+  }
+
+  const Database &db = snapshot.db;
+  std::unique_ptr<Query> q = make(db);
+  q->prefetch = option == "prefetch";
+
+  Accumulator acc;
+  double build = time([&] { q->build(); });
+  double probe = time([&] { acc = q->probe(db.lo); });
+  double finalize = time([&] { q->finalize(acc); });
+
+  for (const std::string &row : q->rows()) {
+    send_line(fd, "row " + row);
+  }
+
+  std::ostringstream timings;
+  timings << "time Build " << build << "\ntime Probe " << probe
+          << "\ntime Finalize " << finalize;
+  send_line(fd, timings.str());
+  send_line(fd, "version " + std::to_string(snapshot.version));
+}
+
+// Shared by every client thread.
+struct Server {
+  std::string path;
+  hash_map<std::string, QueryFactory> factories;
+  Snapshots snapshots;
+
+  // Serializes reloads, so that versions are published in order.
+  std::mutex reload_mutex;
+  uint64_t version = 0;
+
+  // Loads the database at new_path, or again at path if it is empty, while
+  // queries keep running on the current snapshot, then publishes it. Returns
+  // the version published.
+  uint64_t reload(const std::string &new_path) {
+    std::lock_guard<std::mutex> lock(reload_mutex);
+    std::string load_path = new_path.empty() ? path : new_path;
+    snapshots.publish(load_snapshot(load_path, version + 1));
+    path = load_path;
+    return ++version;
+  }
+};
+
+// Answers the requests of one client until it disconnects or sends "quit".
+// Every response ends with "ok", or with "error MESSAGE".
+void serve_client(int fd, Server &server) {
+  LineReader reader(fd);
+  std::string line;
+
+  while (reader.read(line)) {
+    std::istringstream request(line);
+    std::string command;
+    std::string option;
+    request >> command >> option;
+
+    if (command.empty()) {
+      continue;
+    }
+    if (command == "quit") {
+      break;
+    }
+
+    try {
+      if (command == "list") {
+        Snapshots::Ref snapshot = server.snapshots.acquire();
+        for (QueryFactory make : queries) {
+          send_line(fd, "query " + make(snapshot->db)->name);
+        }
+      } else if (command == "reload") {
+        send_line(fd, "version " + std::to_string(server.reload(option)));
+      } else {
+        auto it = server.factories.find(command);
+        if (it == server.factories.end()) {
+          throw std::runtime_error("unknown query " + command);
+        }
+        serve_query(fd, *server.snapshots.acquire(), it->second, option);
+      }
+      send_line(fd, "ok");
+    } catch (const std::runtime_error &e) {
+      send_line(fd, std::string("error ") + e.what());
+    }
+  }
+}
+
+void run_server(const char *path, const char *socket_path) {
+  Server server;
+  server.path = path;
+  server.reload("");
+
+  Snapshots::Ref snapshot = server.snapshots.acquire();
+  for (QueryFactory make : queries) {
+    server.factories.emplace(make(snapshot->db)->name, make);
+  }
+  snapshot.reset();
+
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (std::strlen(socket_path) >= sizeof(addr.sun_path)) {
+    throw std::runtime_error(std::string("socket path too long: ") +
+                             socket_path);
+  }
+  std::strcpy(addr.sun_path, socket_path);
+
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd < 0) {
+    throw std::runtime_error(std::strerror(errno));
+  }
+  unlink(socket_path);
+  if (bind(listen_fd, (const sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(listen_fd, SOMAXCONN) < 0) {
+    throw std::runtime_error(std::strerror(errno));
+  }
+
+  // A client that disconnects mid-response makes the write fail instead.
+  std::signal(SIGPIPE, SIG_IGN);
+
+  log("Server", "Listening", socket_path);
+
+  while (true) {
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      throw std::runtime_error(std::strerror(errno));
+    }
+
+    // Each client gets its own thread; the queries it runs share the TBB
+    // worker pool with every other client's.
+    std::thread([fd, &server] {
+      try {
+        serve_client(fd, server);
+      } catch (const std::exception &e) {
+        log("Server", "ClientError", e.what());
+      }
+      close(fd);
+    }).detach();
+  }
+}
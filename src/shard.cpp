@@ -0,0 +1,258 @@
+#include "query.hpp"
+
+#include "oneapi/tbb.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+void write_all(int fd, const void *data, size_t size) {
+  const char *p = (const char *)data;
+  while (size > 0) {
+    ssize_t n = write(fd, p, size);
+    if (n < 0 && errno != EINTR) {
+      throw std::runtime_error(std::strerror(errno));
+    }
+    if (n > 0) {
+      p += n;
+      size -= n;
+    }
+  }
+}
+
+void read_all(int fd, void *data, size_t size) {
+  char *p = (char *)data;
+  while (size > 0) {
+    ssize_t n = read(fd, p, size);
+    if (n == 0) {
+      throw std::runtime_error("worker exited early");
+    }
+    if (n < 0 && errno != EINTR) {
+      throw std::runtime_error(std::strerror(errno));
+    }
+    if (n > 0) {
+      p += n;
+      size -= n;
+    }
+  }
+}
+
+void send_accumulator(int fd, const Accumulator &acc) {
+  uint64_t size = acc.size();
+  std::vector<uint8_t> flags(size);
+  std::vector<int64_t> sums(size);
+  for (size_t i = 0; i < size; ++i) {
+    flags[i] = acc[i].first;
+    sums[i] = acc[i].second;
+  }
+
+  write_all(fd, &size, sizeof(size));
+  write_all(fd, flags.data(), size * sizeof(uint8_t));
+  write_all(fd, sums.data(), size * sizeof(int64_t));
+}
+
+Accumulator receive_accumulator(int fd) {
+  uint64_t size;
+  read_all(fd, &size, sizeof(size));
+
+  std::vector<uint8_t> flags(size);
+  std::vector<int64_t> sums(size);
+  read_all(fd, flags.data(), size * sizeof(uint8_t));
+  read_all(fd, sums.data(), size * sizeof(int64_t));
+
+  Accumulator acc(size);
+  for (size_t i = 0; i < size; ++i) {
+    acc[i] = {flags[i] != 0, sums[i]};
+  }
+  return acc;
+}
+
+// Loads the dimensions and one rowid range of lineorder, then probes every
+// query over it and sends the partial accumulators to fd in query order.
+void run_worker(const char *path,
+                size_t shard,
+                size_t n_shards,
+                std::pair<int64_t, int64_t> rowids,
+                int fd) {
+  // Split the cores between the workers instead of oversubscribing them.
+  size_t n_threads =
+      std::max<size_t>(1, std::thread::hardware_concurrency() / n_shards);
+  tbb::global_control gc(tbb::global_control::max_allowed_parallelism,
+                         n_threads);
+
+  std::string worker = "Shard" + std::to_string(shard);
+
+  double latency;
+  Database db;
+
+  latency = time([&] {
+    load_dimensions(path, db);
+    load_lineorder(path, db.lo, rowids.first, rowids.second);
+  });
+
+  log(worker, "Load", latency);
+
+  for (QueryFactory make : queries) {
+    std::unique_ptr<Query> q = make(db);
+    q->build();
+
+    Accumulator acc;
+    latency = time([&] { acc = q->probe(db.lo); });
+
+    log(q->name, worker + "Probe", latency);
+
+    send_accumulator(fd, acc);
+  }
+}
+
+// Closes the pipes from the workers and waits for every one of them, killing
+// them first if kill_workers. Returns the shards whose worker did not exit
+// cleanly.
+std::vector<size_t> reap_workers(const std::vector<pid_t> &pids,
+                                 const std::vector<int> &fds,
+                                 bool kill_workers) {
+  if (kill_workers) {
+    for (pid_t pid : pids) {
+      kill(pid, SIGKILL);
+    }
+  }
+
+  for (int fd : fds) {
+    close(fd);
+  }
+
+  std::vector<size_t> failed;
+  for (size_t i = 0; i < pids.size(); ++i) {
+    int status;
+    if (waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+      failed.push_back(i);
+    }
+  }
+  return failed;
+}
+
+// Receives the next partial accumulator from each worker in shard order.
+std::vector<Accumulator> receive_partials(const std::vector<int> &fds) {
+  std::vector<Accumulator> partials;
+  for (size_t i = 0; i < fds.size(); ++i) {
+    try {
+      partials.push_back(receive_accumulator(fds[i]));
+    } catch (const std::exception &e) {
+      throw std::runtime_error("shard " + std::to_string(i) + ": " +
+                               e.what());
+    }
+  }
+  return partials;
+}
+
+// Forks a worker per shard of the rowids [begin, end), appending its pid and
+// the read end of its pipe as soon as it runs.
+void spawn_workers(const char *path,
+                   size_t n_shards,
+                   int64_t begin,
+                   int64_t end,
+                   std::vector<pid_t> &pids,
+                   std::vector<int> &fds) {
+  for (size_t i = 0; i < n_shards; ++i) {
+    std::pair<int64_t, int64_t> rowids(begin + (end - begin) * i / n_shards,
+                                       begin +
+                                           (end - begin) * (i + 1) / n_shards);
+
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0) {
+      throw std::runtime_error(std::strerror(errno));
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+      int error = errno;
+      close(pipe_fds[0]);
+      close(pipe_fds[1]);
+      throw std::runtime_error(std::strerror(error));
+    }
+
+    if (pid == 0) {
+      for (int fd : fds) {
+        close(fd);
+      }
+      close(pipe_fds[0]);
+
+      int status = 0;
+      try {
+        run_worker(path, i, n_shards, rowids, pipe_fds[1]);
+      } catch (const std::exception &e) {
+        // One write, so that workers failing together do not interleave.
+        std::cerr << "shard " + std::to_string(i) + ": " + e.what() + "\n";
+        status = 1;
+      }
+      std::cout.flush();
+      _exit(status);
+    }
+
+    close(pipe_fds[1]);
+    pids.push_back(pid);
+    fds.push_back(pipe_fds[0]);
+  }
+}
+
+// Merges the partial accumulators of every query from fds, then finalizes
+// and prints it.
+void merge_partials(const char *path, const std::vector<int> &fds) {
+  // Finalizing only decodes accumulators, so the coordinator does not need
+  // the tables, only the dictionaries queries resolve their predicates with.
+  Database db;
+  load_dictionaries(path, db);
+
+  for (QueryFactory make : queries) {
+    std::unique_ptr<Query> q = make(db);
+
+    std::vector<Accumulator> partials = receive_partials(fds);
+
+    double latency;
+    Accumulator acc;
+
+    latency = time([&] {
+      acc = partials.front();
+      for (size_t i = 1; i < partials.size(); ++i) {
+        acc = agg_merge(std::move(acc), partials[i]);
+      }
+    });
+
+    log(q->name, "Merge", latency);
+
+    latency = time([&] { q->finalize(acc); });
+
+    log(q->name, "Finalize", latency);
+
+    q->print();
+  }
+}
+
+// Forks the workers and merges what they send. If anything fails, the
+// workers still running are killed and every worker is waited for before
+// the error propagates.
+void run_sharded(const char *path, size_t n_shards) {
+  auto [begin, end] = lineorder_rowids(path);
+
+  std::vector<pid_t> pids;
+  std::vector<int> fds;
+  try {
+    spawn_workers(path, n_shards, begin, end, pids, fds);
+    merge_partials(path, fds);
+  } catch (...) {
+    reap_workers(pids, fds, true);
+    throw;
+  }
+
+  std::vector<size_t> failed = reap_workers(pids, fds, false);
+  if (!failed.empty()) {
+    throw std::runtime_error("shard " + std::to_string(failed.front()) +
+                             " worker failed");
+  }
+}
@@ -0,0 +1,80 @@
+#include "query.hpp"
+
+#include <future>
+
+void run_streaming(const char *path, size_t memory_mb) {
+  double latency;
+  Database db;
+
+  latency = time([&] { load_dimensions(path, db); });
+
+  log("Stream", "LoadDimensions", latency);
+
+  std::vector<std::unique_ptr<Query>> qs;
+  for (QueryFactory make : queries) {
+    qs.push_back(make(db));
+    qs.back()->build();
+  }
+
+  // Two chunks are resident at once: one being probed, one being read. The
+  // reader reserves each at its full size, so they never reallocate.
+  size_t chunk_rows =
+      std::max<size_t>(1, (memory_mb << 20) / (2 * Lineorder::row_bytes));
+
+  log("Stream", "ChunkRows", chunk_rows);
+
+  LineorderReader reader(path);
+  Lineorder chunks[2];
+
+  std::vector<Accumulator> accs(qs.size());
+  std::vector<double> probe_latency(qs.size());
+  double read_stall = 0;
+  size_t n_chunks = 0;
+
+  std::future<bool> next = std::async(std::launch::async, [&] {
+    return reader.read(chunks[0], chunk_rows);
+  });
+
+  while (true) {
+    bool more;
+    read_stall += time([&] { more = next.get(); });
+    if (!more) {
+      break;
+    }
+
+    const Lineorder &chunk = chunks[n_chunks % 2];
+    Lineorder &spare = chunks[(n_chunks + 1) % 2];
+    next = std::async(std::launch::async, [&reader, &spare, chunk_rows] {
+      return reader.read(spare, chunk_rows);
+    });
+
+    for (size_t i = 0; i < qs.size(); ++i) {
+      probe_latency[i] += time([&] {
+        Accumulator acc = qs[i]->probe(chunk);
+        accs[i] = accs[i].empty() ? std::move(acc)
+                                  : agg_merge(std::move(accs[i]), acc);
+      });
+    }
+
+    ++n_chunks;
+  }
+
+  log("Stream", "Chunks", n_chunks);
+  log("Stream", "ReadStall", read_stall);
+
+  for (size_t i = 0; i < qs.size(); ++i) {
+    Query &q = *qs[i];
+
+    log(q.name, "Probe", probe_latency[i]);
+
+    if (accs[i].empty()) {
+      accs[i] = q.probe(Lineorder());
+    }
+
+    latency = time([&] { q.finalize(accs[i]); });
+
+    log(q.name, "Finalize", latency);
+
+    q.print();
+  }
+}
@@ -0,0 +1,229 @@
+#include "column_loader.hpp"
+#include "query.hpp"
+
+#include "oneapi/tbb.h"
+
+#include <sched.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+// Times each phase is run at every thread count, keeping the fastest, so a
+// one-off stall does not pass for a scaling limit.
+constexpr size_t n_repetitions = 3;
+
+// Reads an integer from a sysfs file, or returns fallback if it is missing.
+int read_sysfs(const std::string &path, int fallback) {
+  std::ifstream in(path);
+  int value;
+  return in >> value ? value : fallback;
+}
+
+// The CPUs this process may run on, ordered for placement: with spread, one
+// hardware thread of every physical core first and their SMT siblings after;
+// without, the siblings of each core together, so that n threads fill n / 2
+// cores.
+std::vector<int> placement_order(bool spread) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+    throw std::runtime_error("sched_getaffinity failed");
+  }
+
+  // CPUs by (package, core), in the order the kernel numbers them.
+  std::map<std::pair<int, int>, std::vector<int>> cores;
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &set)) {
+      std::string topology =
+          "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+      int package = read_sysfs(topology + "physical_package_id", 0);
+      int core = read_sysfs(topology + "core_id", cpu);
+      cores[{package, core}].push_back(cpu);
+    }
+  }
+
+  std::vector<int> order;
+  if (spread) {
+    for (size_t sibling = 0; order.size() < size_t(CPU_COUNT(&set));
+         ++sibling) {
+      for (const auto &[core, cpus] : cores) {
+        if (sibling < cpus.size()) {
+          order.push_back(cpus[sibling]);
+        }
+      }
+    }
+  } else {
+    for (const auto &[core, cpus] : cores) {
+      order.insert(order.end(), cpus.begin(), cpus.end());
+    }
+  }
+  return order;
+}
+
+// Pins the thread in each slot of the arena to the CPU at that index of the
+// placement order, as it enters the scheduler.
+class PinningObserver : public tbb::task_scheduler_observer {
+public:
+  explicit PinningObserver(std::vector<int> cpus) : cpus(std::move(cpus)) {
+    observe(true);
+  }
+
+  ~PinningObserver() { observe(false); }
+
+  void on_scheduler_entry(bool) override {
+    int slot = tbb::this_task_arena::current_thread_index();
+    if (slot < 0) {
+      return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpus[slot % cpus.size()], &set);
+    sched_setaffinity(0, sizeof(set), &set);
+  }
+
+private:
+  std::vector<int> cpus;
+};
+
+// Parses a comma-separated list of thread counts, or "all" for the powers of
+// two up to the hardware concurrency and the hardware concurrency itself.
+std::vector<size_t> parse_threads(const std::string &list, size_t max_threads) {
+  std::vector<size_t> threads;
+  if (list == "all") {
+    for (size_t n = 1; n < max_threads; n *= 2) {
+      threads.push_back(n);
+    }
+    threads.push_back(max_threads);
+    return threads;
+  }
+
+  std::istringstream in(list);
+  std::string item;
+  while (std::getline(in, item, ',')) {
+    size_t n = std::stoul(item);
+    if (n == 0 || n > max_threads) {
+      throw std::runtime_error("thread count " + item + " not in [1, " +
+                               std::to_string(max_threads) + "]");
+    }
+    threads.push_back(n);
+  }
+  if (threads.empty()) {
+    throw std::runtime_error("no thread counts to sweep");
+  }
+  return threads;
+}
+
+// Seconds each phase of a query took at each thread count of a sweep.
+struct Timings {
+  std::string query;
+  std::vector<double> build;
+  std::vector<double> probe;
+  std::vector<double> finalize;
+};
+
+// Prints one row per phase and thread count, with the speedup and parallel
+// efficiency over the first thread count swept.
+void print_scaling(const std::vector<Timings> &timings,
+                   const std::vector<size_t> &threads) {
+  std::cout << std::left << std::setw(8) << "Query" << std::setw(10) << "Phase"
+            << std::right << std::setw(8) << "Threads" << std::setw(12)
+            << "Seconds" << std::setw(10) << "Speedup" << std::setw(12)
+            << "Efficiency" << std::endl;
+
+  auto print_phase = [&](const std::string &query,
+                         const std::string &phase,
+                         const std::vector<double> &seconds) {
+    for (size_t i = 0; i < threads.size(); ++i) {
+      double speedup = seconds[0] / seconds[i];
+      double efficiency = speedup * threads[0] / threads[i];
+      std::ostringstream row;
+      row << std::left << std::setw(8) << query << std::setw(10) << phase
+          << std::right << std::setw(8) << threads[i] << std::fixed
+          << std::setprecision(6) << std::setw(12) << seconds[i]
+          << std::setprecision(2) << std::setw(10) << speedup << std::setw(12)
+          << efficiency;
+      std::cout << row.str() << std::endl;
+    }
+  };
+
+  for (const Timings &t : timings) {
+    print_phase(t.query, "Build", t.build);
+    print_phase(t.query, "Probe", t.probe);
+    print_phase(t.query, "Finalize", t.finalize);
+  }
+}
+
+void run_sweep(const char *path,
+               const std::string &thread_list,
+               const std::string &query_list,
+               const std::string &pin) {
+  size_t max_threads = tbb::info::default_concurrency();
+  std::vector<size_t> threads = parse_threads(thread_list, max_threads);
+
+  std::unique_ptr<PinningObserver> observer;
+  if (pin == "spread" || pin == "compact") {
+    observer = std::make_unique<PinningObserver>(
+        placement_order(pin == "spread"));
+  } else if (pin != "none") {
+    throw std::runtime_error("unknown placement " + pin);
+  }
+
+  log("Sweep", "MaxThreads", max_threads);
+  log("Sweep", "Placement", pin);
+
+  Database db;
+  ColumnLoader loader(path, db);
+
+  ColumnSet columns = 0;
+  for (QueryFactory make : queries) {
+    std::unique_ptr<Query> q = make(db);
+    if (selected(query_list, q->name)) {
+      columns |= q->columns();
+    }
+  }
+  loader.load(columns);
+
+  std::vector<Timings> timings;
+  for (QueryFactory make : queries) {
+    Timings t;
+    t.query = make(db)->name;
+    if (!selected(query_list, t.query)) {
+      continue;
+    }
+
+    for (size_t n : threads) {
+      tbb::global_control control(
+          tbb::global_control::max_allowed_parallelism, n);
+
+      double build = 0;
+      double probe = 0;
+      double finalize = 0;
+      for (size_t r = 0; r < n_repetitions; ++r) {
+        std::unique_ptr<Query> q = make(db);
+        Accumulator acc;
+        double b = time([&] { q->build(); });
+        double p = time([&] { acc = q->probe(db.lo); });
+        double f = time([&] { q->finalize(acc); });
+        build = r == 0 ? b : std::min(build, b);
+        probe = r == 0 ? p : std::min(probe, p);
+        finalize = r == 0 ? f : std::min(finalize, f);
+      }
+
+      log(t.query, "Build@" + std::to_string(n), build);
+      log(t.query, "Probe@" + std::to_string(n), probe);
+      log(t.query, "Finalize@" + std::to_string(n), finalize);
+
+      t.build.push_back(build);
+      t.probe.push_back(probe);
+      t.finalize.push_back(finalize);
+    }
+    timings.push_back(std::move(t));
+  }
+
+  print_scaling(timings, threads);
+}
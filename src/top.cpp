@@ -0,0 +1,117 @@
+#include "hash_agg.hpp"
+#include "pipeline.hpp"
+#include "query.hpp"
+
+#include <algorithm>
+
+// One more than the largest key, the domain a key column is grouped over.
+uint64_t domain_of(const std::vector<uint32_t> &keys) {
+  if (keys.empty()) {
+    return 0;
+  }
+  return uint64_t(*std::max_element(keys.begin(), keys.end())) + 1;
+}
+
+// Times the sum of lo.revenue over the rows that rows() passes as a baseline,
+// then the aggregation group() makes of them and the top k groups of its
+// sums, and prints those.
+template <typename R, typename G>
+void run_top_query(const std::string &name,
+                   const Lineorder &lo,
+                   size_t k,
+                   R rows,
+                   G group) {
+  double latency;
+  double scan_latency;
+  GroupSums sums;
+  std::vector<Group> top;
+
+  scan_latency = time([&] { rows().sum(lo.revenue); });
+
+  log(name, "Scan", scan_latency);
+
+  {
+    TraceSpan span(intern(name + " Aggregate"));
+    latency = time([&] { sums = group(rows()); });
+  }
+
+  log(name, "Aggregate", latency);
+  log(name, "AggregateOverScan", latency / scan_latency);
+  log(name, "Path", sums.is_dense() ? "Dense" : "Hash");
+  log(name, "Groups", sums.size());
+  log(name, "AccumulatorBytes", sums.bytes());
+
+  latency = time([&] { top = top_k(sums, k); });
+
+  log(name, "TopK", latency);
+
+  std::vector<std::string> result;
+  for (const auto &[key, sum] : top) {
+    result.push_back(std::to_string(key) + '|' + std::to_string(sum));
+  }
+  print(result);
+}
+
+void run_top(const char *path, size_t k) {
+  Database db;
+
+  load_dimensions(path, db);
+  load_lineorder(path, db.lo);
+
+  const Lineorder &lo = db.lo;
+
+  hash_set<uint32_t> asia;
+  CodeRange region = db.dicts.region.equal("ASIA");
+  for (size_t i = 0; i < db.s.suppkey.size(); ++i) {
+    if (region.contains(db.s.region[i])) {
+      asia.insert(db.s.suppkey[i]);
+    }
+  }
+
+  hash_set<uint32_t> year_1997;
+  for (size_t i = 0; i < db.d.datekey.size(); ++i) {
+    if (db.d.year[i] == 1997) {
+      year_1997.insert(db.d.datekey[i]);
+    }
+  }
+
+  run_top_query(
+      "Top.Customer",
+      lo,
+      k,
+      [&] { return pipeline::scan(lo); },
+      [&](auto rows) {
+        return rows.groupby(lo.custkey, domain_of(db.c.custkey))
+            .sum(lo.revenue);
+      });
+
+  run_top_query(
+      "Top.SupplierAsia",
+      lo,
+      k,
+      [&] { return pipeline::scan(lo).semijoin(asia, lo.suppkey); },
+      [&](auto rows) {
+        return rows.groupby(lo.suppkey, domain_of(db.s.suppkey))
+            .sum(lo.revenue);
+      });
+
+  run_top_query(
+      "Top.Part1997",
+      lo,
+      k,
+      [&] { return pipeline::scan(lo).semijoin(year_1997, lo.orderdate); },
+      [&](auto rows) {
+        return rows.groupby(lo.partkey, domain_of(db.p.partkey))
+            .sum(lo.revenue);
+      });
+
+  run_top_query(
+      "Top.Day",
+      lo,
+      k,
+      [&] { return pipeline::scan(lo); },
+      [&](auto rows) {
+        return rows.groupby(lo.orderdate, domain_of(db.d.datekey))
+            .sum(lo.revenue);
+      });
+}
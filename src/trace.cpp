@@ -0,0 +1,96 @@
+#include "trace.hpp"
+#include "common.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+// Spans each thread keeps; older ones are overwritten.
+constexpr size_t ring_size = size_t(1) << 16;
+
+struct Ring {
+  std::vector<Span> spans = std::vector<Span>(ring_size);
+  size_t n_recorded = 0;
+};
+
+static const auto trace_start = std::chrono::steady_clock::now();
+
+static std::mutex trace_mutex;
+static std::vector<std::unique_ptr<Ring>> rings;
+static std::set<std::string> names;
+
+uint64_t trace_clock() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - trace_start)
+      .count();
+}
+
+// The calling thread's ring, registered on first use. Rings outlive their
+// threads so that spans of finished workers are still written.
+Ring &local_ring() {
+  thread_local Ring *ring = [] {
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    rings.push_back(std::make_unique<Ring>());
+    return rings.back().get();
+  }();
+  return *ring;
+}
+
+void record(const Span &span) {
+  Ring &ring = local_ring();
+  ring.spans[ring.n_recorded++ % ring_size] = span;
+}
+
+const char *intern(const std::string &name) {
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  return names.insert(name).first->c_str();
+}
+
+void write_trace(const std::string &path) {
+  std::ofstream out(path);
+  if (!out) {
+    throw std::runtime_error("cannot open " + path);
+  }
+
+  out << std::fixed << std::setprecision(3);
+
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  size_t n_dropped = 0;
+  const char *separator = "\n";
+
+  out << "{\"traceEvents\":[";
+  for (size_t tid = 0; tid < rings.size(); ++tid) {
+    const Ring &ring = *rings[tid];
+
+    out << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+        << "\"tid\":" << tid << ",\"args\":{\"name\":\"thread " << tid
+        << "\"}}";
+    separator = ",\n";
+
+    size_t first = ring.n_recorded > ring_size ? ring.n_recorded - ring_size
+                                               : 0;
+    n_dropped += first;
+    for (size_t i = first; i < ring.n_recorded; ++i) {
+      const Span &span = ring.spans[i % ring_size];
+      out << separator << "{\"name\":\"" << span.name
+          << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+          << ",\"ts\":" << span.begin_ns / 1e3
+          << ",\"dur\":" << (span.end_ns - span.begin_ns) / 1e3;
+      if (span.end_row > span.begin_row) {
+        out << ",\"args\":{\"begin\":" << span.begin_row
+            << ",\"end\":" << span.end_row
+            << ",\"rows\":" << span.end_row - span.begin_row << "}";
+      }
+      out << "}";
+    }
+  }
+  out << "\n]}\n";
+
+  log("Trace", "Threads", rings.size());
+  log("Trace", "DroppedSpans", n_dropped);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Whether TraceSpans record. Set once, before any span opens.
+inline std::atomic<bool> tracing{false};
+
+// A span of time one thread spent on a phase or on a morsel of rows
+// [begin_row, end_row).
+struct Span {
+  const char *name;
+  uint64_t begin_ns;
+  uint64_t end_ns;
+  size_t begin_row;
+  size_t end_row;
+};
+
+// Nanoseconds since the process started.
+uint64_t trace_clock();
+
+// Appends a span to the calling thread's ring buffer, overwriting its oldest
+// span once full.
+void record(const Span &span);
+
+// Returns a copy of name that lives until exit, for names built at run time.
+const char *intern(const std::string &name);
+
+// Records the span of its own lifetime when tracing is on.
+class TraceSpan {
+public:
+  explicit TraceSpan(const char *name, size_t begin_row = 0, size_t end_row = 0)
+      : name(tracing.load(std::memory_order_relaxed) ? name : nullptr),
+        begin_ns(this->name ? trace_clock() : 0), begin_row(begin_row),
+        end_row(end_row) {}
+
+  TraceSpan(const TraceSpan &) = delete;
+  TraceSpan &operator=(const TraceSpan &) = delete;
+
+  ~TraceSpan() {
+    if (name) {
+      record({name, begin_ns, trace_clock(), begin_row, end_row});
+    }
+  }
+
+private:
+  const char *name;
+  uint64_t begin_ns;
+  size_t begin_row;
+  size_t end_row;
+};
+
+// Writes every recorded span to path as Chrome trace-event JSON, one track
+// per thread, for chrome://tracing or ui.perfetto.dev.
+void write_trace(const std::string &path);